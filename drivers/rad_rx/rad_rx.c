@@ -9,287 +9,1037 @@
 #include <kernel.h>
 #include <device.h>
 #include <devicetree.h>
-#include <drivers/gpio.h>
 
 #include <logging/log.h>
+#include <pm/device.h>
+#if CONFIG_RAD_RX_STATS_SUBSYS
+#include <stats/stats.h>
+#endif
 
 #include <drivers/rad_rx.h>
 
+#include "rad_rx_capture.h"
+#include "rad_rx_internal.h"
+
 LOG_MODULE_REGISTER(rad_rx, CONFIG_RAD_RX_LOG_LEVEL);
 
-typedef enum
-{
-    MSG_STATE_WAIT_FOR_LINE_CLEAR,
-    MSG_STATE_WAIT_FOR_PREAMBLE,
-    MSG_STATE_WAIT_FOR_1,
-    MSG_STATE_WAIT_FOR_0,
-    MSG_STATE_COMPLETE,
-    MSG_STATE_COUNT
-} msg_state_t;
+/**
+ * Pulse lengths, in capture ticks, are handed from the edge ISR to the decoder through a
+ * single-producer/single-consumer ring. The ISR is the only writer of 'head' and the decoder
+ * is the only writer of 'tail'. The beginning of a frame is marked in-band with RAD_RX_EDGE_FRAME_START
+ * so capture never has to stop while a previous frame is being decoded.
+ */
+#define RAD_RX_EDGE_FRAME_START UINT32_MAX
+#define RAD_RX_EDGE_RING_MASK   (CONFIG_RAD_RX_EDGE_RING_SIZE - 1)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_RAD_RX_EDGE_RING_SIZE),
+                "CONFIG_RAD_RX_EDGE_RING_SIZE must be a power of two");
+
+static const struct rad_protocol * const m_protocols[] = {
+#if CONFIG_RAD_RX_ACCEPT_RAD
+    &rad_msg_type_rad_protocol,
+#endif
+#if CONFIG_RAD_RX_ACCEPT_LASER_X
+    &rad_msg_type_laser_x_protocol,
+#endif
+#if CONFIG_RAD_RX_ACCEPT_DYNASTY
+    &rad_msg_type_dynasty_protocol,
+#endif
+#if CONFIG_RAD_RX_ACCEPT_LEARNED
+    &rad_msg_type_learned_protocol,
+#endif
+};
+
+#define NUM_PROTOCOLS ARRAY_SIZE(m_protocols)
+
+BUILD_ASSERT(NUM_PROTOCOLS <= 32, "Candidates are tracked in a 32-bit mask");
+
+#if CONFIG_RAD_RX_COLLISION_DETECT
+/**
+ * A frame is only considered to be a collision once it has looked like a message for this many
+ * pulses, otherwise noise that happens to contain a start pulse would be counted.
+ */
+#define COLLISION_MIN_PULSES 8
+#define COLLISION_NONE       RAD_RX_COLLISION_COUNT
+
+/* Shortest and longest bit pulse of each message type. */
+static rad_window_t m_bit_spans[NUM_PROTOCOLS];
+#endif
+
+#if CONFIG_RAD_RX_REPEAT_SUPPRESS
+/* A copy may only be complete once the line is clear after it. */
+#define REPEAT_MARGIN_MS DIV_ROUND_UP(RAD_RX_LINE_CLEAR_LEN_US, USEC_PER_MSEC)
+#endif
+
+#if CONFIG_RAD_RX_STATS_SUBSYS
+/* Totals over all message types, the per-type counters are only in struct rad_rx_stats. */
+STATS_SECT_START(rad_rx)
+STATS_SECT_ENTRY32(edges)
+STATS_SECT_ENTRY32(glitches)
+STATS_SECT_ENTRY32(frames)
+STATS_SECT_ENTRY32(overflows)
+STATS_SECT_ENTRY32(line_clear_timeouts)
+STATS_SECT_ENTRY32(dropped)
+STATS_SECT_ENTRY32(repeats)
+STATS_SECT_ENTRY32(accepted)
+STATS_SECT_ENTRY32(rejected)
+STATS_SECT_END;
+
+STATS_NAME_START(rad_rx)
+STATS_NAME(rad_rx, edges)
+STATS_NAME(rad_rx, glitches)
+STATS_NAME(rad_rx, frames)
+STATS_NAME(rad_rx, overflows)
+STATS_NAME(rad_rx, line_clear_timeouts)
+STATS_NAME(rad_rx, dropped)
+STATS_NAME(rad_rx, repeats)
+STATS_NAME(rad_rx, accepted)
+STATS_NAME(rad_rx, rejected)
+STATS_NAME_END(rad_rx);
+
+#define STATS_GROUP_INCN(p_data, name, n) STATS_INCN((p_data)->stats_group, name, n)
+#else
+#define STATS_GROUP_INCN(p_data, name, n)
+#endif
+
+#if CONFIG_RAD_RX_STATS
+/* 'counter' is the member of struct rad_rx_stats and 'name' the total that it adds to. */
+#define STAT_INC(p_data, counter, name) do { \
+        (p_data)->stats.counter++; \
+        STATS_GROUP_INCN(p_data, name, 1); \
+    } while (0)
+#else
+#define STAT_INC(p_data, counter, name)
+#endif
+
+#if CONFIG_RAD_RX_WORKQUEUE
+static K_THREAD_STACK_DEFINE(m_workqueue_stack, CONFIG_RAD_RX_WORKQUEUE_STACK_SIZE);
+static struct k_work_q m_workqueue;
+static bool            m_workqueue_started;
+#endif
+
+#if CONFIG_RAD_RX_CALLBACK_THREAD
+K_MSGQ_DEFINE(m_deliveries, sizeof(struct rad_rx_delivery), CONFIG_RAD_RX_CALLBACK_QUEUE_SIZE, 4);
+
+static atomic_t m_deliveries_dropped;
+#endif
 
 struct rad_rx_data {
     bool                  ready;
 
     const struct device  *dev;
-    struct gpio_callback  cb_data;
-    uint8_t               pin;
+    struct rad_rx_capture capture;
 
     rad_rx_callback_t     cb;
+#if CONFIG_RAD_RX_GROUP
+    const struct device  *group;
+    uint8_t               sensor;
+#endif
+
+    /* Decodes the ring when kicked by the ISR and closes the frame once the line is clear. */
+    struct k_work_delayable work;
+    atomic_t              kicked;     /* The ISR has already kicked the decoder. */
+#if CONFIG_PM_DEVICE
+    struct k_work         suspend_work; /* Drains the decoder on its own queue when suspending. */
+#endif
 
-    struct k_timer        timer;
-    struct k_work         work;
+    /* Producer (ISR) side of the edge ring. */
+    uint32_t              edges[CONFIG_RAD_RX_EDGE_RING_SIZE];
+    atomic_t              head;
+    atomic_t              overflows;
+    atomic_t              edge_count; /* Odd while the line is active. */
+    uint32_t              timestamp;  /* Time of the last edge that was pushed. */
+#if CONFIG_RAD_RX_GLITCH_FILTER_US
+    uint32_t              mark_start; /* Time of the last active edge. */
+#endif
+    uint32_t              frames;     /* Frame starts pushed so far. */
+    bool                  resync;
 
-    uint32_t              message[RAD_RX_MSG_MAX_LEN];
-    uint32_t              timestamp;
-    atomic_t              index;
-    msg_state_t           state;
+    /* Written by the decoder once no message type can match the rest of a frame. */
+    atomic_t              muted_frame;
 
-#if CONFIG_RAD_RX_ACCEPT_RAD
-    rad_parse_state_t     rad_parse_state;
+    /* Consumer (decoder) side of the edge ring. */
+    atomic_t              tail;
+    uint32_t              overflows_seen;
+    uint32_t              frame;      /* Frame starts popped so far. */
+    uint32_t              frame_timestamp;
+    uint32_t              edges_seen; /* edge_count when the line clear deadline was set. */
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    bool                  asleep;     /* The backend was told to sleep until the line is active. */
 #endif
-#if CONFIG_RAD_RX_ACCEPT_DYNASTY
-    rad_parse_state_t     dynasty_parse_state;
+    uint32_t              candidates; /* Message types that the current frame can still be. */
+    rad_parser_t          parsers[NUM_PROTOCOLS];
+
+#if CONFIG_RAD_RX_COLLISION_DETECT
+    uint16_t              pulses;     /* Pulses of the current frame so far. */
+    bool                  delivered;  /* A message was decoded from the current frame. */
+    bool                  trailing;   /* Waiting to see if the frame goes on after the message. */
+    uint8_t               anomaly;    /* Collision that the current frame looks like so far. */
+    uint32_t              collisions[RAD_RX_COLLISION_COUNT];
 #endif
-#if CONFIG_RAD_RX_ACCEPT_LASER_X
-    rad_parse_state_t     laser_x_parse_state;
+
+#if CONFIG_RAD_RX_EVENT_QUEUE
+    struct k_msgq         events;
+    uint32_t              events_dropped;
+    char __aligned(4)     events_buf[CONFIG_RAD_RX_EVENT_QUEUE_SIZE * sizeof(struct rad_rx_event)];
+#endif
+
+#if CONFIG_RAD_RX_REPEAT_SUPPRESS
+    /* The last message, held back until no more copies of it can arrive. */
+    struct k_work_delayable repeat_work;
+    struct rad_rx_event   repeat;
+    bool                  repeat_held;
+    uint32_t              repeat_timestamp; /* Start of the frame of the last copy. */
+    int64_t               repeat_deadline;  /* Uptime at which the message is delivered. */
+    uint16_t              repeat_window_ms[RAD_MSG_TYPE_COUNT];
 #endif
-};
 
-struct rad_rx_cfg {
-    const char * const port;
-    const uint8_t      pin;
-    const uint32_t     flags;
+#if CONFIG_RAD_RX_RECORD
+    struct rad_rx_record  record;     /* The train being recorded by the decoder. */
+    bool                  recording;
+    uint32_t              records_dropped;
+    struct k_msgq         records;
+    char __aligned(4)     records_buf[CONFIG_RAD_RX_RECORD_QUEUE_SIZE * sizeof(struct rad_rx_record)];
+#endif
+
+#if CONFIG_RAD_RX_STATS
+    /* 'edges', 'glitches' and 'frames' are counted by the ISR, everything else by the decoder. */
+    struct rad_rx_stats   stats;
+#endif
+#if CONFIG_RAD_RX_STATS_SUBSYS
+    STATS_SECT_DECL(rad_rx) stats_group;
+#endif
 };
 
-static void line_clear(struct rad_rx_data *p_data)
+static inline uint8_t sensor_id(const struct rad_rx_data *p_data)
 {
-    p_data->state = MSG_STATE_WAIT_FOR_PREAMBLE;
-    atomic_set(&p_data->index, 0);
-#if CONFIG_RAD_RX_ACCEPT_RAD
-    p_data->rad_parse_state     = RAD_PARSE_STATE_WAIT_FOR_START_PULSE;
+    return ((const struct rad_rx_cfg *)p_data->dev->config)->sensor_id;
+}
+
+static inline bool edge_space(struct rad_rx_data *p_data, uint32_t head, uint32_t count)
+{
+    if ((CONFIG_RAD_RX_EDGE_RING_SIZE - count) < (head - (uint32_t)atomic_get(&p_data->tail))) {
+        atomic_inc(&p_data->overflows);
+        p_data->resync = true;
+        return false;
+    }
+    return true;
+}
+
+static inline void edge_push(struct rad_rx_data *p_data, uint32_t value)
+{
+    uint32_t head = (uint32_t)atomic_get(&p_data->head);
+
+    if (p_data->resync) {
+        /* Edges were lost so the rest of the current frame is useless. */
+        return;
+    }
+
+    if (!edge_space(p_data, head, 1)) {
+        return;
+    }
+
+    p_data->edges[head & RAD_RX_EDGE_RING_MASK] = value;
+    atomic_set(&p_data->head, (atomic_val_t)(head + 1));
+}
+
+static inline void frame_start_push(struct rad_rx_data *p_data, uint32_t timestamp)
+{
+    /* The marker is always followed by the time of the edge that started the frame. */
+    uint32_t head = (uint32_t)atomic_get(&p_data->head);
+
+    if (!edge_space(p_data, head, 2)) {
+        return;
+    }
+
+    p_data->edges[head & RAD_RX_EDGE_RING_MASK]       = RAD_RX_EDGE_FRAME_START;
+    p_data->edges[(head + 1) & RAD_RX_EDGE_RING_MASK] = timestamp;
+    atomic_set(&p_data->head, (atomic_val_t)(head + 2));
+    p_data->resync = false;
+    p_data->frames++;
+    STAT_INC(p_data, frames, frames);
+}
+
+static inline bool pulse_push(struct rad_rx_data *p_data, uint32_t len, uint32_t end, bool active)
+{
+    /* 'active' is the polarity of the edge that ended the pulse at 'end'. */
+    if (active && (RAD_RX_LINE_CLEAR_LEN_TICKS <= len)) {
+        /* The line has been idle long enough that this edge begins a new frame. */
+        frame_start_push(p_data, end);
+        return true;
+    }
+
+#if !CONFIG_RAD_RX_RECORD
+    if (p_data->frames == (uint32_t)atomic_get(&p_data->muted_frame)) {
+        /* Noise or a foreign signal that has already been rejected. Don't wake the decoder. */
+        return false;
+    }
 #endif
-#if CONFIG_RAD_RX_ACCEPT_DYNASTY
-    p_data->dynasty_parse_state = RAD_PARSE_STATE_WAIT_FOR_START_PULSE;
+
+    edge_push(p_data, MIN(len, (RAD_RX_EDGE_FRAME_START - 1)));
+    return true;
+}
+
+static inline bool edge_pop(struct rad_rx_data *p_data, uint32_t *value)
+{
+    uint32_t tail = (uint32_t)atomic_get(&p_data->tail);
+
+    if (tail == (uint32_t)atomic_get(&p_data->head)) {
+        return false;
+    }
+
+    *value = p_data->edges[tail & RAD_RX_EDGE_RING_MASK];
+    atomic_set(&p_data->tail, (atomic_val_t)(tail + 1));
+    return true;
+}
+
+#if CONFIG_RAD_RX_RECORD
+static void record_close(struct rad_rx_data *p_data)
+{
+    if (!p_data->recording) {
+        return;
+    }
+    p_data->recording = false;
+
+    if (0 != k_msgq_put(&p_data->records, &p_data->record, K_NO_WAIT)) {
+        LOG_WRN("Record queue full, pulse train dropped (%u total)", ++p_data->records_dropped);
+    }
+}
+
+static void record_open(struct rad_rx_data *p_data)
+{
+    record_close(p_data);
+
+    p_data->recording        = true;
+    p_data->record.timestamp = p_data->frame_timestamp;
+    p_data->record.len       = 0;
+    p_data->record.sensor_id = sensor_id(p_data);
+    p_data->record.flags     = 0;
+}
+
+static void record_pulse(struct rad_rx_data *p_data, uint32_t len)
+{
+    if (!p_data->recording) {
+        return;
+    }
+
+    if (CONFIG_RAD_RX_RECORD_MAX_PULSES <= p_data->record.len) {
+        p_data->record.flags |= RAD_RX_RECORD_FLAG_TRUNCATED;
+        return;
+    }
+    p_data->record.pulses_us[p_data->record.len++] = MIN(RAD_RX_TICKS_TO_US(len), UINT16_MAX);
+}
+#endif /* CONFIG_RAD_RX_RECORD */
+
+static void frame_end(struct rad_rx_data *p_data)
+{
+#if CONFIG_RAD_RX_STATS
+    /* The line cleared while these message types were still waiting for pulses. */
+    uint32_t candidates = p_data->candidates;
+
+    if (0 == candidates) {
+        return;
+    }
+
+    STAT_INC(p_data, line_clear_timeouts, line_clear_timeouts);
+    while (candidates) {
+        int i = (find_lsb_set(candidates) - 1);
+
+        STAT_INC(p_data, rejected[m_protocols[i]->msg_type][RAD_PARSE_REJECT_TRUNCATED], rejected);
+        candidates &= ~BIT(i);
+    }
 #endif
-#if CONFIG_RAD_RX_ACCEPT_LASER_X
-    p_data->laser_x_parse_state = RAD_PARSE_STATE_WAIT_FOR_START_PULSE;
+}
+
+static bool frame_open(const struct rad_rx_data *p_data)
+{
+#if CONFIG_RAD_RX_COLLISION_DETECT
+    if (p_data->trailing) {
+        return true;
+    }
 #endif
+    return (0 != p_data->candidates);
 }
 
-static void line_clear_timer_expire(struct k_timer *timer_id)
+static void frame_close(struct rad_rx_data *p_data)
 {
-    // NOTE: Ensure that this interrupt has a higher priority than the GPIO interrupt
-    //       to preclude a race condition.
-    struct rad_rx_data *p_data = CONTAINER_OF(timer_id, struct rad_rx_data, timer);
-    line_clear(p_data);
+    /* The line is clear so a message type that is still waiting for pulses never gets them. */
+    frame_end(p_data);
+    p_data->candidates = 0;
+#if CONFIG_RAD_RX_COLLISION_DETECT
+    p_data->trailing   = false;
+#endif
 }
 
-static void message_decode(struct k_work *item)
+#if CONFIG_RAD_RX_COLLISION_DETECT
+static void bit_spans_init(void)
+{
+    for (int i=0; i < NUM_PROTOCOLS; i++) {
+        const struct rad_protocol *protocol = m_protocols[i];
+
+        m_bit_spans[i].min = UINT32_MAX;
+        m_bit_spans[i].max = 0;
+        for (int j=0; j < 2; j++) {
+            for (int k=0; k < protocol->pulses_per_bit; k++) {
+                m_bit_spans[i].min = MIN(m_bit_spans[i].min, protocol->symbol_window[j][k].min);
+                m_bit_spans[i].max = MAX(m_bit_spans[i].max, protocol->symbol_window[j][k].max);
+            }
+        }
+    }
+}
+#endif
+
+static void frame_start(struct rad_rx_data *p_data)
+{
+    frame_end(p_data);
+
+#if CONFIG_RAD_RX_COLLISION_DETECT && CONFIG_RAD_RX_ACCEPT_LEARNED
+    /* The learned message type can be described again at any time. */
+    bit_spans_init();
+#endif
+
+    p_data->frame++;
+    p_data->candidates = BIT_MASK(NUM_PROTOCOLS);
+#if CONFIG_RAD_RX_COLLISION_DETECT
+    p_data->pulses     = 0;
+    p_data->delivered  = false;
+    p_data->trailing   = false;
+    p_data->anomaly    = COLLISION_NONE;
+#endif
+    for (int i=0; i < NUM_PROTOCOLS; i++) {
+        rad_parser_reset(&p_data->parsers[i]);
+    }
+}
+
+static void delivery_run(const struct rad_rx_delivery *delivery)
+{
+    sys_trace_rad_rx_callback(delivery->sensor_id, delivery->msg_type);
+
+    if (delivery->group_cb) {
+        delivery->group_cb(delivery->msg_type, (void*)&delivery->msg, delivery->sensors);
+    } else {
+        delivery->cb(delivery->msg_type, (void*)&delivery->msg);
+    }
+}
+
+void rad_rx_deliver(const struct rad_rx_delivery *delivery)
+{
+#if CONFIG_RAD_RX_CALLBACK_THREAD
+    if (0 != k_msgq_put(&m_deliveries, delivery, K_NO_WAIT)) {
+        /* Never wait for the callback thread, the decoder has edges to keep up with. */
+        LOG_WRN("Callback queue full, message dropped (%d total)",
+                (int)(atomic_inc(&m_deliveries_dropped) + 1));
+    }
+#else
+    delivery_run(delivery);
+#endif
+}
+
+int rad_rx_work_schedule(struct k_work_delayable *work, k_timeout_t delay)
+{
+#if CONFIG_RAD_RX_WORKQUEUE
+    return k_work_schedule_for_queue(&m_workqueue, work, delay);
+#else
+    return k_work_schedule(work, delay);
+#endif
+}
+
+static void event_deliver(struct rad_rx_data *p_data, const struct rad_rx_event *event)
+{
+#if CONFIG_RAD_RX_EVENT_QUEUE
+    if (0 != k_msgq_put(&p_data->events, event, K_NO_WAIT)) {
+        LOG_WRN("Event queue full, message dropped (%u total)", ++p_data->events_dropped);
+        STAT_INC(p_data, dropped, dropped);
+    }
+#endif
+
+#if CONFIG_RAD_RX_GROUP
+    if (p_data->group) {
+        rad_rx_group_report(p_data->group, p_data->sensor, event->msg_type, &event->msg);
+    }
+#endif
+
+    if (p_data->cb) {
+        struct rad_rx_delivery delivery = {
+            .cb        = p_data->cb,
+            .msg_type  = event->msg_type,
+            .sensor_id = event->sensor_id,
+            .msg       = event->msg,
+        };
+
+        rad_rx_deliver(&delivery);
+    }
+}
+
+#if CONFIG_RAD_RX_REPEAT_SUPPRESS
+static void repeat_flush(struct k_work *item)
 {
-    struct rad_rx_data *p_data       = CONTAINER_OF(item, struct rad_rx_data, work);
-    uint32_t            len          = (atomic_get(&p_data->index) - 1);
-    bool                msg_finished = true;
+    struct k_work_delayable *dwork  = k_work_delayable_from_work(item);
+    struct rad_rx_data      *p_data = CONTAINER_OF(dwork, struct rad_rx_data, repeat_work);
+    int64_t                  now    = k_uptime_get();
 
-    if (MSG_STATE_WAIT_FOR_LINE_CLEAR == p_data->state) {
-        /* There might be one additional input change after giving up on the message. */
+    if (!p_data->repeat_held) {
         return;
     }
 
-#if CONFIG_RAD_RX_ACCEPT_RAD
-    rad_msg_rad_t rad_msg;
-    switch (p_data->rad_parse_state) {
-    case RAD_PARSE_STATE_WAIT_FOR_START_PULSE:
-        if (!IS_VALID_START_PULSE(p_data->message[0], RAD_MSG_TYPE_RAD_START_PULSE_LEN_US)) {
-            p_data->rad_parse_state = RAD_PARSE_STATE_INVALID;
-            break;
-        } else {
-            msg_finished            = false;
-            p_data->rad_parse_state = RAD_PARSE_STATE_INCOMPLETE;
-            // Fall-through into the next state in case the entire message is received.
-        }
-    case RAD_PARSE_STATE_INCOMPLETE:
-        if (RAD_MSG_TYPE_RAD_LEN_PULSES > len) {
-            msg_finished = false;
-            break;
-        } else if (RAD_MSG_TYPE_RAD_LEN_PULSES < len) {
-            p_data->rad_parse_state = RAD_PARSE_STATE_INVALID;
-            break;
-        }
+    if (now < p_data->repeat_deadline) {
+        /* Another copy arrived since this was scheduled. */
+        rad_rx_work_schedule(dwork, K_MSEC(p_data->repeat_deadline - now));
+        return;
+    }
+
+    p_data->repeat_held = false;
+    event_deliver(p_data, &p_data->repeat);
+}
+
+static bool repeat_merge(struct rad_rx_data *p_data, const struct rad_rx_event *event)
+{
+    /**
+     * Returns true if the message is held back instead of delivered. Copies of a message have
+     * the same length so the next copy is decoded at most a window after this one. The flush
+     * runs on the decoding workqueue too so none of this needs locking.
+     */
+    struct rad_rx_event *held      = &p_data->repeat;
+    uint16_t             window_ms = p_data->repeat_window_ms[event->msg_type];
+    uint32_t             window    = RAD_RX_US_TO_TICKS_FLOOR((uint32_t)window_ms * USEC_PER_MSEC);
 
-        p_data->rad_parse_state = rad_msg_type_rad_parse(&p_data->message[0], len, &rad_msg);
-        if (RAD_PARSE_STATE_VALID == p_data->rad_parse_state) {
-            if (p_data->cb) {
-                p_data->cb(RAD_MSG_TYPE_RAD, (void*)&rad_msg);
+    if (p_data->repeat_held) {
+        if ((held->msg_type == event->msg_type) &&
+            ((event->timestamp - p_data->repeat_timestamp) <= window) &&
+            (0 == memcmp(&held->msg, &event->msg, rad_rx_msg_len(event->msg_type)))) {
+            /* Report the quality of the best copy. */
+            held->confidence = MAX(held->confidence, event->confidence);
+            held->repaired   = MIN(held->repaired, event->repaired);
+            if (held->repeats < UINT8_MAX) {
+                held->repeats++;
             }
+            p_data->repeat_timestamp = event->timestamp;
+            p_data->repeat_deadline  = (k_uptime_get() + window_ms + REPEAT_MARGIN_MS);
+            STAT_INC(p_data, repeats, repeats);
+            return true;
         }
-        break;
-    default:
-        break;
+
+        /* A different message, so the held one won't get any more copies. */
+        p_data->repeat_held = false;
+        event_deliver(p_data, held);
+    }
+
+    if (0 == window_ms) {
+        return false;
+    }
+
+    *held                    = *event;
+    p_data->repeat_held      = true;
+    p_data->repeat_timestamp = event->timestamp;
+    p_data->repeat_deadline  = (k_uptime_get() + window_ms + REPEAT_MARGIN_MS);
+    rad_rx_work_schedule(&p_data->repeat_work, K_MSEC(window_ms + REPEAT_MARGIN_MS));
+    return true;
+}
+#endif /* CONFIG_RAD_RX_REPEAT_SUPPRESS */
+
+static void msg_deliver(struct rad_rx_data *p_data,
+                        const struct rad_protocol *protocol,
+                        const rad_parser_t *parser,
+                        rad_msg_t *msg)
+{
+    struct rad_rx_event event = {
+        .type       = RAD_RX_EVENT_MSG,
+        .msg_type   = protocol->msg_type,
+        .msg        = *msg,
+        .timestamp  = p_data->frame_timestamp,
+        .sensor_id  = sensor_id(p_data),
+        .confidence = rad_parser_confidence(protocol, parser),
+        .repaired   = rad_parser_repaired(parser),
+        .repeats    = 1,
+    };
+
+#if CONFIG_RAD_RX_SOFT_DECISION && (CONFIG_RAD_RX_MIN_CONFIDENCE > 0)
+    if (event.confidence < CONFIG_RAD_RX_MIN_CONFIDENCE) {
+        LOG_DBG("Message dropped (%u%% confidence)", event.confidence);
+        return;
     }
 #endif
 
-#if CONFIG_RAD_RX_ACCEPT_LASER_X
-    rad_msg_laser_x_t laser_x_msg;
-    switch (p_data->laser_x_parse_state) {
-    case RAD_PARSE_STATE_WAIT_FOR_START_PULSE:
-        if (!IS_VALID_START_PULSE(p_data->message[0], RAD_MSG_TYPE_LASER_X_START_PULSE_LEN_US)){
-            p_data->laser_x_parse_state = RAD_PARSE_STATE_INVALID;
-            break;
-        } else {
-            msg_finished                = false;
-            p_data->laser_x_parse_state = RAD_PARSE_STATE_INCOMPLETE;
-            // Fall-through into the next state in case the entire message is received.
-        }
-    case RAD_PARSE_STATE_INCOMPLETE:
-        if (RAD_MSG_TYPE_LASER_X_LEN_PULSES > len) {
-            msg_finished = false;
-            break;
-        } else if (RAD_MSG_TYPE_LASER_X_LEN_PULSES < len) {
-            p_data->laser_x_parse_state = RAD_PARSE_STATE_INVALID;
-            break;
+#if CONFIG_RAD_RX_RECORD
+    p_data->record.flags |= RAD_RX_RECORD_FLAG_DECODED;
+#endif
+
+#if CONFIG_RAD_RX_REPEAT_SUPPRESS
+    if (repeat_merge(p_data, &event)) {
+        return;
+    }
+#endif
+
+    event_deliver(p_data, &event);
+}
+
+static void frame_mute(struct rad_rx_data *p_data)
+{
+    /* Ignore the rest of the frame until the line clears. A stale value is harmless
+     * because the ISR only compares it against the frame it is currently capturing.
+     */
+    atomic_set(&p_data->muted_frame, (atomic_val_t)p_data->frame);
+}
+
+#if CONFIG_RAD_RX_COLLISION_DETECT
+static void collision_report(struct rad_rx_data *p_data, enum rad_rx_collision collision)
+{
+    p_data->collisions[collision]++;
+    LOG_DBG("Collision %d (%u total)", collision, p_data->collisions[collision]);
+
+#if CONFIG_RAD_RX_EVENT_QUEUE
+    struct rad_rx_event event = {
+        .type      = RAD_RX_EVENT_COLLISION,
+        .collision = collision,
+        .timestamp = p_data->frame_timestamp,
+        .sensor_id = sensor_id(p_data),
+    };
+
+    if (0 != k_msgq_put(&p_data->events, &event, K_NO_WAIT)) {
+        LOG_WRN("Event queue full, collision dropped (%u total)", ++p_data->events_dropped);
+        STAT_INC(p_data, dropped, dropped);
+    }
+#endif
+}
+
+static void collision_check(struct rad_rx_data *p_data, uint32_t pulse)
+{
+    /**
+     * Two transmitters overlapping at the sensor produce pulses that none of the message types
+     * that the frame can still be would ever send: merged pulses that are too long, fragments
+     * that are too short, or the start pulse of the second frame in the middle of the first.
+     */
+    uint32_t candidates = p_data->candidates;
+    bool     active     = (0 == (p_data->pulses % 2));
+
+    if (p_data->pulses++ < COLLISION_MIN_PULSES) {
+        return;
+    }
+
+    while (candidates) {
+        int i = (find_lsb_set(candidates) - 1);
+
+        if (RAD_RX_IN_WINDOW(pulse, m_bit_spans[i])) {
+            return;
         }
+        candidates &= ~BIT(i);
+    }
 
-        p_data->laser_x_parse_state = rad_msg_type_laser_x_parse(&p_data->message[0],
-                                                                   len,
-                                                                   &laser_x_msg);
-        if (RAD_PARSE_STATE_VALID == p_data->laser_x_parse_state) {
-            if (p_data->cb) {
-                p_data->cb(RAD_MSG_TYPE_LASER_X, (void*)&laser_x_msg);
-            }
+    for (int i=0; active && (i < NUM_PROTOCOLS); i++) {
+        if (RAD_RX_IN_WINDOW(pulse, m_protocols[i]->start_window)) {
+            p_data->anomaly = RAD_RX_COLLISION_START;
+            return;
         }
-        break;
-    default:
-        break;
     }
+
+    if (COLLISION_NONE == p_data->anomaly) {
+        p_data->anomaly = RAD_RX_COLLISION_WIDTH;
+    }
+}
+#endif /* CONFIG_RAD_RX_COLLISION_DETECT */
+
+static void pulse_decode(struct rad_rx_data *p_data, uint32_t pulse)
+{
+    /**
+     * Every message type that the frame can still be consumes the pulse, like the states of an
+     * NFA. A message type drops out on the first pulse that can't belong to it and once none
+     * are left the ISR is told to stop passing on the rest of the frame.
+     */
+    uint32_t candidates = p_data->candidates;
+
+#if CONFIG_RAD_RX_COLLISION_DETECT
+    collision_check(p_data, pulse);
 #endif
 
-#if CONFIG_RAD_RX_ACCEPT_DYNASTY
-    rad_msg_dynasty_t dynasty_msg;
-    switch (p_data->dynasty_parse_state) {
-    case RAD_PARSE_STATE_WAIT_FOR_START_PULSE:
-        if (!IS_VALID_START_PULSE(p_data->message[0], RAD_MSG_TYPE_DYNASTY_START_PULSE_LEN_US)){
-            p_data->dynasty_parse_state = RAD_PARSE_STATE_INVALID;
-            break;
-        } else {
-            msg_finished                = false;
-            p_data->dynasty_parse_state = RAD_PARSE_STATE_INCOMPLETE;
-            // Fall-through into the next state in case the entire message is received.
+    while (candidates) {
+        int           i      = (find_lsb_set(candidates) - 1);
+        rad_parser_t *parser = &p_data->parsers[i];
+        rad_msg_t     msg;
+
+        candidates &= ~BIT(i);
+
+        parser->state = rad_protocol_parse_pulse(m_protocols[i], parser, pulse, &msg);
+        if (RAD_PARSE_STATE_INCOMPLETE == parser->state) {
+            continue;
         }
-    case RAD_PARSE_STATE_INCOMPLETE:
-        if (RAD_MSG_TYPE_DYNASTY_LEN_PULSES > len) {
-            msg_finished = false;
+
+        sys_trace_rad_rx_parse(sensor_id(p_data), m_protocols[i]->msg_type, parser->state);
+        switch (parser->state) {
+        case RAD_PARSE_STATE_VALID:
+            STAT_INC(p_data, accepted[m_protocols[i]->msg_type], accepted);
+            msg_deliver(p_data, m_protocols[i], parser, &msg);
+#if CONFIG_RAD_RX_COLLISION_DETECT
+            p_data->delivered = true;
+#endif
             break;
-        } else if (RAD_MSG_TYPE_DYNASTY_LEN_PULSES < len) {
-            p_data->dynasty_parse_state = RAD_PARSE_STATE_INVALID;
+        default:
+            STAT_INC(p_data, rejected[m_protocols[i]->msg_type][parser->reject], rejected);
             break;
         }
+        p_data->candidates &= ~BIT(i);
+    }
 
-        p_data->dynasty_parse_state = rad_msg_type_dynasty_parse(&p_data->message[0],
-                                                                    len,
-                                                                    &dynasty_msg);
-        if (RAD_PARSE_STATE_VALID == p_data->dynasty_parse_state) {
-            if (p_data->cb) {
-                p_data->cb(RAD_MSG_TYPE_DYNASTY, (void*)&dynasty_msg);
-            }
-        }
-        break;
-    default:
-        break;
+    if (0 != p_data->candidates) {
+        return;
     }
-#endif
 
-    if (msg_finished) {
-        p_data->state = MSG_STATE_WAIT_FOR_LINE_CLEAR;
-        line_clear(p_data);
-    } else {
-        k_timer_start(&p_data->timer, K_USEC(RAD_RX_LINE_CLEAR_LEN_US), K_NO_WAIT);
+#if CONFIG_RAD_RX_COLLISION_DETECT
+    if (p_data->delivered) {
+        /* Any further pulse before the line clears means that the frame was too long. */
+        p_data->trailing = true;
+        return;
     }
+
+    if (COLLISION_NONE != p_data->anomaly) {
+        collision_report(p_data, p_data->anomaly);
+    }
+#endif
+    frame_mute(p_data);
 }
 
-static void input_changed(const struct device *dev, struct gpio_callback *cb_data, uint32_t pins)
+static void polarity_check(struct rad_rx_data *p_data)
 {
     /**
-     * line_clear_timer_expired will preempt message_decode so the timer should only be started
-     * when the IR receiver's pin is deasserted AND message_decode has had a chance to run.
+     * The ISR infers the polarity of each edge from the number of edges so far. If an edge is
+     * ever lost (e.g. two edges within the interrupt latency) then every pulse after it would
+     * be inverted. Compare against the real level and flip the count back into phase, unless
+     * an edge arrived while the pin was being read.
      */
-    struct rad_rx_data *p_data = CONTAINER_OF(cb_data, struct rad_rx_data, cb_data);
+    atomic_val_t count  = atomic_get(&p_data->edge_count);
+    bool         active = rad_rx_capture_level_get(&p_data->capture);
 
-    bool pin_state = gpio_pin_get(dev, p_data->pin);
-    if (pin_state) {
-        k_timer_stop(&p_data->timer);
+    if (((count & 1) != 0) != active) {
+        if (atomic_cas(&p_data->edge_count, count, (count + 1))) {
+            LOG_WRN("Edge polarity resynchronized");
+        }
     }
+}
 
-    if (MSG_STATE_WAIT_FOR_LINE_CLEAR == p_data->state) {
-        if (!pin_state) {
-            k_timer_start(&p_data->timer, K_USEC(RAD_RX_LINE_CLEAR_LEN_US), K_NO_WAIT);
-        }
-        return;
+static bool deadline_needed(const struct rad_rx_data *p_data)
+{
+    /* Something has to happen once the line has been clear for a while. */
+    if (frame_open(p_data)) {
+        return true;
+    }
+#if CONFIG_RAD_RX_RECORD
+    if (p_data->recording) {
+        return true;
+    }
+#endif
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    if (!p_data->asleep) {
+        return true;
     }
+#endif
+    return false;
+}
 
-    uint32_t now   = k_cyc_to_us_near32(k_cycle_get_32());
-    uint32_t index = atomic_inc(&p_data->index); /* index is set to the pre-incremented valued */
+static void message_decode(struct k_work *item)
+{
+    /**
+     * Runs when the ISR kicks it at the end of a pulse and, while a frame is still open, once
+     * the line has been idle for RAD_RX_LINE_CLEAR_LEN_US. If no edge arrived in between and
+     * the line is inactive then the frame is over. An odd edge count means the line is still
+     * active, i.e. a mark longer than the deadline, so the deadline is re-armed instead. This
+     * replaces both a timer per frame and a submission per pulse: the ISR only kicks the decoder
+     * again once the decoder has started running.
+     */
+    struct k_work_delayable *dwork  = k_work_delayable_from_work(item);
+    struct rad_rx_data      *p_data = CONTAINER_OF(dwork, struct rad_rx_data, work);
+    uint32_t                 edges;
+    uint32_t                 overflows;
+    uint32_t                 value;
 
-    if (0 < index) {
-        if (RAD_RX_MSG_MAX_LEN < index) {
-            if (!pin_state) {
-                k_timer_start(&p_data->timer, K_USEC(RAD_RX_LINE_CLEAR_LEN_US), K_NO_WAIT);
-            }
-            return;
+    atomic_clear(&p_data->kicked);
+    edges = (uint32_t)atomic_get(&p_data->edge_count);
+
+    sys_trace_rad_rx_decode_enter(sensor_id(p_data));
+
+    if ((edges == p_data->edges_seen) && (0 == (edges & 1))) {
+#if CONFIG_RAD_RX_RECORD
+        record_close(p_data);
+#endif
+        if (frame_open(p_data)) {
+            frame_close(p_data);
         }
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+        else if (!p_data->asleep) {
+            /* Still clear with no frame to close. Stop timing edges until the next frame. */
+            p_data->asleep = true;
+            rad_rx_capture_sleep(&p_data->capture);
+        }
+#endif
+    }
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    else {
+        p_data->asleep = false;
+    }
+#endif
 
-        if (p_data->timestamp <= now) {
-            p_data->message[index-1] = (now - p_data->timestamp);
-        } else {
-            p_data->message[index-1] = (0xFFFFFFFF - p_data->timestamp);
-            p_data->message[index-1] += now;
+    while (edge_pop(p_data, &value)) {
+        if (RAD_RX_EDGE_FRAME_START == value) {
+            edge_pop(p_data, &p_data->frame_timestamp);
+            frame_start(p_data);
+#if CONFIG_RAD_RX_RECORD
+            record_open(p_data);
+#endif
+            continue;
         }
 
-        if (!pin_state) {
-            k_work_submit(&p_data->work);
+#if CONFIG_RAD_RX_RECORD
+        record_pulse(p_data, value);
+#endif
+
+        if (p_data->candidates) {
+            pulse_decode(p_data, value);
+        }
+#if CONFIG_RAD_RX_COLLISION_DETECT
+        else if (p_data->trailing) {
+            p_data->trailing = false;
+            collision_report(p_data, RAD_RX_COLLISION_LENGTH);
+            frame_mute(p_data);
         }
+#endif
     }
-    p_data->timestamp = now;
+
+    overflows = (uint32_t)atomic_get(&p_data->overflows);
+    if (overflows != p_data->overflows_seen) {
+        LOG_WRN("Edge ring overflowed (%u total)", overflows);
+        STATS_GROUP_INCN(p_data, overflows, (overflows - p_data->overflows_seen));
+        p_data->overflows_seen = overflows;
+#if CONFIG_RAD_RX_RECORD
+        p_data->record.flags  |= RAD_RX_RECORD_FLAG_OVERFLOW;
+#endif
+    }
+
+    polarity_check(p_data);
+
+    if (deadline_needed(p_data)) {
+        /* Has no effect if the ISR kicked the decoder again in the meantime. */
+        p_data->edges_seen = edges;
+        rad_rx_work_schedule(&p_data->work, K_USEC(RAD_RX_LINE_CLEAR_LEN_US));
+    }
+
+    sys_trace_rad_rx_decode_exit(sensor_id(p_data));
 }
 
+static void decoder_kick(struct rad_rx_data *p_data)
+{
+    if (atomic_cas(&p_data->kicked, 0, 1)) {
+        /* Decode now, replacing the line clear deadline if there is one. */
+        sys_trace_rad_rx_work_submit(sensor_id(p_data));
+#if CONFIG_RAD_RX_WORKQUEUE
+        k_work_reschedule_for_queue(&m_workqueue, &p_data->work, K_NO_WAIT);
+#else
+        k_work_reschedule(&p_data->work, K_NO_WAIT);
+#endif
+    }
+}
+
+void rad_rx_capture_edge(struct rad_rx_capture *capture, uint32_t timestamp)
+{
+    struct rad_rx_data *p_data = CONTAINER_OF(capture, struct rad_rx_data, capture);
+
+    sys_trace_rad_rx_edge(sensor_id(p_data));
+
+    /* Unsigned subtraction is correct across a wrap of the tick counter. */
+    uint32_t len    = (timestamp - p_data->timestamp);
+    bool     active = (atomic_inc(&p_data->edge_count) & 1) == 0;
+
+    STAT_INC(p_data, edges, edges);
+
+#if CONFIG_RAD_RX_GLITCH_FILTER_US
+    if (active) {
+        /* Hold the space back until the mark that ends it turns out not to be a glitch. */
+        p_data->mark_start = timestamp;
+        return;
+    }
+
+    if ((timestamp - p_data->mark_start) < RAD_RX_GLITCH_LEN_TICKS) {
+        /* Merged into the surrounding space as if neither edge had happened. */
+        STAT_INC(p_data, glitches, glitches);
+        return;
+    }
+
+    pulse_push(p_data, (p_data->mark_start - p_data->timestamp), p_data->mark_start, true);
+    len = (timestamp - p_data->mark_start);
+#endif
+
+    p_data->timestamp = timestamp;
+
+    if (!pulse_push(p_data, len, timestamp, active)) {
+        return;
+    }
+
+    if (!active) {
+        decoder_kick(p_data);
+    }
+}
+
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+void rad_rx_capture_wake(struct rad_rx_capture *capture, uint32_t timestamp)
+{
+    struct rad_rx_data *p_data = CONTAINER_OF(capture, struct rad_rx_data, capture);
+
+    if (atomic_get(&p_data->edge_count) & 1) {
+        /* The active edge was already timed before the backend went to sleep. */
+        return;
+    }
+
+    /**
+     * The backend only sleeps after the line has been clear for a whole deadline so this edge
+     * begins a frame. Its exact time is all that matters: the space before it isn't measured.
+     */
+    p_data->timestamp = (timestamp - RAD_RX_LINE_CLEAR_LEN_TICKS);
+    rad_rx_capture_edge(capture, timestamp);
+}
+#endif
+
+struct rad_rx_capture *rad_rx_capture_get(const struct device *dev)
+{
+    struct rad_rx_data *p_data = dev->data;
+    return &p_data->capture;
+}
+
+#if CONFIG_PM_DEVICE
+static void suspend_drain(struct k_work *item)
+{
+    /**
+     * Runs on the decoding workqueue like everything else that touches the decoder, the
+     * repeat and event state and the group, so neither the decoder nor a group flush can run
+     * at the same time and cancelling without waiting is enough.
+     */
+    struct rad_rx_data *p_data = CONTAINER_OF(item, struct rad_rx_data, suspend_work);
+
+    /* Whatever is left in the ring is decoded now. A frame that was cut short is dropped. */
+    k_work_cancel_delayable(&p_data->work);
+    message_decode(&p_data->work.work);
+    k_work_cancel_delayable(&p_data->work);
+    frame_close(p_data);
+#if CONFIG_RAD_RX_RECORD
+    record_close(p_data);
+#endif
+#if CONFIG_RAD_RX_REPEAT_SUPPRESS
+    /* No more copies can arrive so a held message is delivered now. */
+    k_work_cancel_delayable(&p_data->repeat_work);
+    if (p_data->repeat_held) {
+        p_data->repeat_held = false;
+        event_deliver(p_data, &p_data->repeat);
+    }
+#endif
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    p_data->asleep = true;
+#endif
+}
+#endif /* CONFIG_PM_DEVICE */
+
 static int dmv_rad_rx_init(const struct device *dev)
 {
     int err;
     struct rad_rx_data      *p_data = dev->data;
     const struct rad_rx_cfg *p_cfg  = dev->config;
 
-    k_timer_init(&p_data->timer, line_clear_timer_expire, NULL);
-    k_work_init(&p_data->work, message_decode);
+#if CONFIG_RAD_RX_WORKQUEUE
+    if (!m_workqueue_started) {
+        const struct k_work_queue_config config = { .name = "rad_rx" };
 
-    p_data->dev = device_get_binding(p_cfg->port);
-    if (!p_data->dev) {
-        return -ENODEV;
+        k_work_queue_start(&m_workqueue,
+                           m_workqueue_stack,
+                           K_THREAD_STACK_SIZEOF(m_workqueue_stack),
+                           CONFIG_RAD_RX_WORKQUEUE_PRIORITY,
+                           &config);
+        m_workqueue_started = true;
     }
+#endif
+
+#if CONFIG_RAD_RX_COLLISION_DETECT
+    bit_spans_init();
+    memset(p_data->collisions, 0, sizeof(p_data->collisions));
+    p_data->trailing = false;
+#endif
+
+    k_work_init_delayable(&p_data->work, message_decode);
+    atomic_clear(&p_data->kicked);
+#if CONFIG_PM_DEVICE
+    k_work_init(&p_data->suspend_work, suspend_drain);
+#endif
+
+    p_data->head   = ATOMIC_INIT(0);
+    p_data->tail   = ATOMIC_INIT(0);
+    p_data->resync = false;
+    p_data->cb     = NULL;
 
-    err = gpio_pin_configure(p_data->dev, p_cfg->pin, (GPIO_INPUT | p_cfg->flags));
+    /* Nothing is decoded until the line has been clear once. */
+    p_data->frames     = 0;
+    p_data->frame      = 0;
+    p_data->candidates = 0;
+    atomic_set(&p_data->muted_frame, 0);
+
+    p_data->dev    = dev;
+
+#if CONFIG_RAD_RX_STATS
+    memset(&p_data->stats, 0, sizeof(p_data->stats));
+#endif
+#if CONFIG_RAD_RX_STATS_SUBSYS
+    err = stats_init_and_reg(STATS_HDR(p_data->stats_group),
+                             STATS_SIZE_INIT_PARMS(p_data->stats_group, STATS_SIZE_32),
+                             STATS_NAME_INIT_PARMS(rad_rx),
+                             dev->name);
     if (err != 0) {
-        return err;
+        /* The driver's own counters still work. */
+        LOG_WRN("Stats group registration failed (err %d)", err);
+    }
+#endif
+
+#if CONFIG_RAD_RX_EVENT_QUEUE
+    k_msgq_init(&p_data->events, p_data->events_buf, sizeof(struct rad_rx_event),
+                CONFIG_RAD_RX_EVENT_QUEUE_SIZE);
+#endif
+#if CONFIG_RAD_RX_RECORD
+    k_msgq_init(&p_data->records, p_data->records_buf, sizeof(struct rad_rx_record),
+                CONFIG_RAD_RX_RECORD_QUEUE_SIZE);
+    p_data->recording = false;
+#endif
+#if CONFIG_RAD_RX_REPEAT_SUPPRESS
+    k_work_init_delayable(&p_data->repeat_work, repeat_flush);
+    p_data->repeat_held = false;
+    for (int i=0; i < RAD_MSG_TYPE_COUNT; i++) {
+        p_data->repeat_window_ms[i] = CONFIG_RAD_RX_REPEAT_WINDOW_MS;
     }
+#endif
 
-    err = gpio_pin_interrupt_configure(p_data->dev, p_cfg->pin, GPIO_INT_EDGE_BOTH);
+    err = rad_rx_capture_init(&p_data->capture, p_cfg);
     if (err != 0) {
         return err;
     }
+    atomic_set(&p_data->edge_count, rad_rx_capture_level_get(&p_data->capture) ? 1 : 0);
 
-    gpio_init_callback(&p_data->cb_data, input_changed, BIT(p_cfg->pin));
-    gpio_add_callback(p_data->dev, &p_data->cb_data);
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    p_data->asleep     = true;
+    p_data->edges_seen = (uint32_t)atomic_get(&p_data->edge_count);
+    rad_rx_capture_sleep(&p_data->capture);
+#endif
 
-    p_data->state = MSG_STATE_WAIT_FOR_LINE_CLEAR;
-    p_data->index = ATOMIC_INIT(0);
-    p_data->cb    = NULL;
     p_data->ready = true;
-    p_data->pin   = p_cfg->pin;
+    return 0;
+}
+
+#if CONFIG_RAD_RX_CALLBACK_THREAD
+static void callback_thread(void *p1, void *p2, void *p3)
+{
+    struct rad_rx_delivery delivery;
 
-    if (!gpio_pin_get(p_data->dev, p_cfg->pin)) {
-        k_timer_start(&p_data->timer, K_USEC(RAD_RX_LINE_CLEAR_LEN_US), K_NO_WAIT);
+    while (true) {
+        k_msgq_get(&m_deliveries, &delivery, K_FOREVER);
+        delivery_run(&delivery);
     }
-    return 0;
 }
 
+K_THREAD_DEFINE(rad_rx_callback_thread, CONFIG_RAD_RX_CALLBACK_THREAD_STACK_SIZE,
+                callback_thread, NULL, NULL, NULL,
+                CONFIG_RAD_RX_CALLBACK_THREAD_PRIORITY, 0, 0);
+#endif
+
 static int dmv_rad_set_callback(const struct device *dev, rad_rx_callback_t cb)
 {
     struct rad_rx_data *p_data = dev->data;
@@ -297,24 +1047,226 @@ static int dmv_rad_set_callback(const struct device *dev, rad_rx_callback_t cb)
     return 0;
 }
 
+#if CONFIG_RAD_RX_GROUP
+int rad_rx_group_attach(const struct device *dev, const struct device *group, uint8_t sensor)
+{
+    struct rad_rx_data *p_data = dev->data;
+
+    if (p_data->group) {
+        return -EALREADY;
+    }
+    p_data->sensor = sensor;
+    p_data->group  = group;
+    return 0;
+}
+#endif
+
+#if CONFIG_RAD_RX_EVENT_QUEUE
+static int dmv_rad_rx_read(const struct device *dev,
+                           struct rad_rx_event *events,
+                           size_t max,
+                           k_timeout_t timeout)
+{
+    struct rad_rx_data *p_data = dev->data;
+    size_t              count  = 0;
+
+    if (0 == max) {
+        return 0;
+    }
+
+    /* Only wait for the first event, then take whatever else is already there. */
+    if (0 != k_msgq_get(&p_data->events, &events[count], timeout)) {
+        return 0;
+    }
+
+    for (count=1; count < max; count++) {
+        if (0 != k_msgq_get(&p_data->events, &events[count], K_NO_WAIT)) {
+            break;
+        }
+    }
+    return count;
+}
+
+#if CONFIG_POLL
+static int dmv_rad_rx_poll_init(const struct device *dev, struct k_poll_event *event)
+{
+    struct rad_rx_data *p_data = dev->data;
+
+    k_poll_event_init(event,
+                      K_POLL_TYPE_MSGQ_DATA_AVAILABLE,
+                      K_POLL_MODE_NOTIFY_ONLY,
+                      &p_data->events);
+    return 0;
+}
+#endif /* CONFIG_POLL */
+#endif /* CONFIG_RAD_RX_EVENT_QUEUE */
+
+#if CONFIG_RAD_RX_COLLISION_DETECT
+static int dmv_rad_rx_collisions_get(const struct device *dev, uint32_t *counts)
+{
+    struct rad_rx_data *p_data = dev->data;
+
+    /* Counts are only written by the decoder so a torn read can't happen per counter. */
+    memcpy(counts, p_data->collisions, sizeof(p_data->collisions));
+    return 0;
+}
+#endif
+
+#if CONFIG_RAD_RX_STATS
+static int dmv_rad_rx_stats_get(const struct device *dev, struct rad_rx_stats *stats)
+{
+    struct rad_rx_data *p_data = dev->data;
+
+    *stats           = p_data->stats;
+    stats->overflows = (uint32_t)atomic_get(&p_data->overflows);
+    return 0;
+}
+#endif
+
+#if CONFIG_RAD_RX_RECORD
+static int dmv_rad_rx_record_read(const struct device *dev,
+                                  struct rad_rx_record *record,
+                                  k_timeout_t timeout)
+{
+    struct rad_rx_data *p_data = dev->data;
+
+    return (0 == k_msgq_get(&p_data->records, record, timeout)) ? 0 : -EAGAIN;
+}
+
+static int dmv_rad_rx_replay(const struct device *dev, const uint16_t *pulses_us, size_t len)
+{
+    struct rad_rx_data *p_data = dev->data;
+    unsigned int        key;
+    uint32_t            head;
+
+    if ((0 == len) || ((len + 2) > CONFIG_RAD_RX_EDGE_RING_SIZE)) {
+        /* Could never be replayed, unlike a train that waits for room in the ring. */
+        return -EINVAL;
+    }
+
+    /* The pulses go through the edge ring like real ones so the ISR is the one kept out. */
+    key  = irq_lock();
+    head = (uint32_t)atomic_get(&p_data->head);
+
+    if ((atomic_get(&p_data->edge_count) & 1) ||
+        ((CONFIG_RAD_RX_EDGE_RING_SIZE - (len + 2)) < (head - (uint32_t)atomic_get(&p_data->tail)))) {
+        irq_unlock(key);
+        return -EBUSY;
+    }
+
+    frame_start_push(p_data, p_data->timestamp);
+    for (size_t i=0; i < len; i++) {
+        edge_push(p_data, RAD_RX_US_TO_TICKS_FLOOR(pulses_us[i]));
+    }
+    /* Real pulses are dropped until the next frame so they can't run on from the replay. */
+    p_data->resync = true;
+    irq_unlock(key);
+
+    decoder_kick(p_data);
+    return 0;
+}
+#endif /* CONFIG_RAD_RX_RECORD */
+
+#if CONFIG_RAD_RX_REPEAT_SUPPRESS
+static int dmv_rad_rx_repeat_window_set(const struct device *dev,
+                                        rad_msg_type_t msg_type,
+                                        uint16_t window_ms)
+{
+    struct rad_rx_data *p_data = dev->data;
+
+    /* Takes effect from the next message. A message that is already held isn't affected. */
+    p_data->repeat_window_ms[msg_type] = window_ms;
+    return 0;
+}
+#endif
+
+#if CONFIG_PM_DEVICE
+static int dmv_rad_rx_pm_action(const struct device *dev, enum pm_device_action action)
+{
+    struct rad_rx_data *p_data = dev->data;
+    struct k_work_sync  sync;
+    int                 err;
+
+    switch (action) {
+    case PM_DEVICE_ACTION_SUSPEND:
+        err = rad_rx_capture_suspend(&p_data->capture);
+        if (err != 0) {
+            return err;
+        }
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+        /* Keeps the decoder from putting the suspended backend to sleep. */
+        p_data->asleep = true;
+#endif
+        /* Must not be called from the decoding workqueue, e.g. from a receiver callback. */
+#if CONFIG_RAD_RX_WORKQUEUE
+        k_work_submit_to_queue(&m_workqueue, &p_data->suspend_work);
+#else
+        k_work_submit(&p_data->suspend_work);
+#endif
+        k_work_flush(&p_data->suspend_work, &sync);
+        return 0;
+
+    case PM_DEVICE_ACTION_RESUME:
+        /* Edges were missed so nothing is decoded until the line has been clear again. */
+        atomic_set(&p_data->muted_frame, (atomic_val_t)p_data->frames);
+        atomic_set(&p_data->edge_count, rad_rx_capture_level_get(&p_data->capture) ? 1 : 0);
+        p_data->edges_seen = (uint32_t)atomic_get(&p_data->edge_count);
+        return rad_rx_capture_resume(&p_data->capture);
+
+    default:
+        return -ENOTSUP;
+    }
+}
+#endif /* CONFIG_PM_DEVICE */
+
 static const struct rad_rx_driver_api rad_rx_driver_api = {
-    .init         = dmv_rad_rx_init,
-    .set_callback = dmv_rad_set_callback,
+    .init           = dmv_rad_rx_init,
+    .set_callback   = dmv_rad_set_callback,
+#if CONFIG_RAD_RX_EVENT_QUEUE
+    .read           = dmv_rad_rx_read,
+#if CONFIG_POLL
+    .poll_init      = dmv_rad_rx_poll_init,
+#endif
+#endif
+#if CONFIG_RAD_RX_COLLISION_DETECT
+    .collisions_get = dmv_rad_rx_collisions_get,
+#endif
+#if CONFIG_RAD_RX_STATS
+    .stats_get      = dmv_rad_rx_stats_get,
+#endif
+#if CONFIG_RAD_RX_RECORD
+    .record_read    = dmv_rad_rx_record_read,
+    .replay         = dmv_rad_rx_replay,
+#endif
+#if CONFIG_RAD_RX_REPEAT_SUPPRESS
+    .repeat_window_set = dmv_rad_rx_repeat_window_set,
+#endif
 };
 
 #define INST(num) DT_INST(num, dmv_rad_rx)
 
+#if CONFIG_RAD_RX_CAPTURE_TIMER
+#define RAD_RX_CFG_PSEL(n) \
+        .psel  = NRF_GPIO_PIN_MAP(DT_PROP(DT_GPIO_CTLR(INST(n), gpios), port), \
+                                  DT_GPIO_PIN(INST(n), gpios)),
+#else
+#define RAD_RX_CFG_PSEL(n)
+#endif
+
 #define RAD_RX_DEVICE(n) \
     static const struct rad_rx_cfg rad_rx_cfg_##n = { \
         .port  = DT_GPIO_LABEL(INST(n), gpios), \
         .pin   = DT_GPIO_PIN(INST(n),   gpios), \
         .flags = DT_GPIO_FLAGS(INST(n), gpios), \
+        .sensor_id = DT_PROP_OR(INST(n), sensor_id, n), \
+        RAD_RX_CFG_PSEL(n) \
     }; \
     static struct rad_rx_data rad_rx_data_##n; \
+    PM_DEVICE_DEFINE(rad_rx_##n, dmv_rad_rx_pm_action); \
     DEVICE_DEFINE(rad_rx_##n, \
                 DT_LABEL(INST(n)), \
                 dmv_rad_rx_init, \
-                NULL, \
+                PM_DEVICE_GET(rad_rx_##n), \
                 &rad_rx_data_##n, \
                 &rad_rx_cfg_##n, \
                 POST_KERNEL, \
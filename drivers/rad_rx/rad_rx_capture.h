@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#ifndef ZEPHYR_DRIVERS_RAD_RX_CAPTURE_H_
+#define ZEPHYR_DRIVERS_RAD_RX_CAPTURE_H_
+
+#include <kernel.h>
+#include <device.h>
+#include <drivers/gpio.h>
+
+#if CONFIG_RAD_RX_CAPTURE_TIMER
+#include <hal/nrf_gpio.h>
+#include <nrfx_ppi.h>
+#endif
+
+/**
+ * The receiver doesn't care where its edges come from. Exactly one capture backend is built
+ * (see CONFIG_RAD_RX_CAPTURE) and it reports every edge of the sensor output, along with the
+ * time at which it happened in RAD_RX_TICKS_PER_SEC ticks, to rad_rx_capture_edge. The edge
+ * interrupt doesn't read the pin: edges alternate so the receiver infers the polarity and
+ * only asks the backend for the level of the pin from thread context to catch lost edges.
+ */
+struct rad_rx_cfg {
+    const char * const port;
+    const uint8_t      pin;
+    const uint32_t     flags;
+    const uint8_t      sensor_id;
+#if CONFIG_RAD_RX_CAPTURE_TIMER
+    const uint32_t     psel; /* Absolute pin number (port and pin) as used by GPIOTE. */
+#endif
+};
+
+struct rad_rx_capture {
+#if CONFIG_RAD_RX_CAPTURE_GPIO || CONFIG_RAD_RX_CAPTURE_TIMER
+    const struct device  *port;
+    struct gpio_callback  cb_data;
+    uint8_t               pin;
+#endif
+#if CONFIG_RAD_RX_CAPTURE_TIMER
+    uint32_t              psel;
+    uint8_t               cc;
+    nrf_ppi_channel_t     ppi;
+#endif
+#if CONFIG_RAD_RX_CAPTURE_SIM
+    uint32_t              now;
+    bool                  active;
+#endif
+#if CONFIG_RAD_RX_CAPTURE_SIM || CONFIG_PM_DEVICE
+    bool                  suspended;
+#endif
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    bool                  sleeping;
+#endif
+};
+
+/**
+ * @brief Start capturing edges. Implemented by the capture backend.
+ */
+int rad_rx_capture_init(struct rad_rx_capture *capture, const struct rad_rx_cfg *p_cfg);
+
+/**
+ * @brief Read the current level of the line. Implemented by the capture backend.
+ *
+ * @return true if the line is active. Only called from thread context.
+ */
+bool rad_rx_capture_level_get(struct rad_rx_capture *capture);
+
+/**
+ * @brief Report an edge. Implemented by the driver and called by the capture backend.
+ *
+ * @param capture   The backend state embedded in the driver instance.
+ * @param timestamp Time of the edge in ticks. Only the difference between consecutive
+ *                  timestamps is used so it's free to wrap at 2^32.
+ */
+void rad_rx_capture_edge(struct rad_rx_capture *capture, uint32_t timestamp);
+
+/**
+ * @brief Get the backend state of a receiver. Implemented by the driver.
+ */
+struct rad_rx_capture *rad_rx_capture_get(const struct device *dev);
+
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+/**
+ * @brief Stop timing edges until the line becomes active. Implemented by the capture backend.
+ *
+ * Only called from thread context once the line has been clear for a while. The backend calls
+ * rad_rx_capture_wake, instead of rad_rx_capture_edge, when the line becomes active again.
+ */
+void rad_rx_capture_sleep(struct rad_rx_capture *capture);
+
+/**
+ * @brief Report that the line became active while sleeping. Implemented by the driver.
+ */
+void rad_rx_capture_wake(struct rad_rx_capture *capture, uint32_t timestamp);
+#endif /* CONFIG_RAD_RX_WAKE_ON_LEVEL */
+
+#if CONFIG_PM_DEVICE
+/**
+ * @brief Stop reporting edges. Implemented by the capture backend.
+ */
+int rad_rx_capture_suspend(struct rad_rx_capture *capture);
+
+/**
+ * @brief Report edges again, or sleep with CONFIG_RAD_RX_WAKE_ON_LEVEL. Implemented by the
+ *        capture backend.
+ */
+int rad_rx_capture_resume(struct rad_rx_capture *capture);
+#endif /* CONFIG_PM_DEVICE */
+
+#if CONFIG_RAD_RX_CAPTURE_TIMER
+/**
+ * @brief Connect the GPIOTE event of the pin to a TIMER capture task.
+ */
+int rad_rx_capture_timer_init(struct rad_rx_capture *capture, const struct rad_rx_cfg *p_cfg);
+
+/**
+ * @brief Read the time at which the most recent edge was latched.
+ */
+uint32_t rad_rx_capture_timer_get(const struct rad_rx_capture *capture);
+
+/**
+ * @brief Connect the pin to its capture register again after the edge interrupt was
+ *        reconfigured. The TIMER runs while any receiver is started.
+ *
+ * @return The current time.
+ */
+uint32_t rad_rx_capture_timer_start(struct rad_rx_capture *capture);
+
+/**
+ * @brief Disconnect the pin from its capture register, e.g. before sleeping.
+ */
+void rad_rx_capture_timer_stop(struct rad_rx_capture *capture);
+#endif /* CONFIG_RAD_RX_CAPTURE_TIMER */
+
+#endif /* ZEPHYR_DRIVERS_RAD_RX_CAPTURE_H_ */
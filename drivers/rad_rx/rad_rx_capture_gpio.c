@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <kernel.h>
+#include <device.h>
+#include <drivers/gpio.h>
+
+#include "rad_rx_capture.h"
+
+#if CONFIG_RAD_RX_CAPTURE_GPIO
+BUILD_ASSERT(!IS_ENABLED(CONFIG_TIMER_READS_ITS_FREQUENCY_AT_RUNTIME),
+                "RAD_RX_TICKS_PER_SEC must be known at build time");
+#endif
+
+/**
+ * Edges are reported by the GPIO edge interrupt. Without a hardware timestamp the time of the
+ * edge is read in the callback so any interrupt latency ends up in the pulse lengths.
+ */
+static inline uint32_t timestamp_get(const struct rad_rx_capture *capture)
+{
+#if CONFIG_RAD_RX_CAPTURE_TIMER
+    return rad_rx_capture_timer_get(capture);
+#else
+    return k_cycle_get_32();
+#endif
+}
+
+static uint32_t edges_enable(struct rad_rx_capture *capture)
+{
+    gpio_pin_interrupt_configure(capture->port, capture->pin, GPIO_INT_EDGE_BOTH);
+#if CONFIG_RAD_RX_CAPTURE_TIMER
+    return rad_rx_capture_timer_start(capture);
+#else
+    return k_cycle_get_32();
+#endif
+}
+
+static void edges_disable(struct rad_rx_capture *capture, gpio_flags_t flags)
+{
+#if CONFIG_RAD_RX_CAPTURE_TIMER
+    rad_rx_capture_timer_stop(capture);
+#endif
+    gpio_pin_interrupt_configure(capture->port, capture->pin, flags);
+}
+
+static void input_changed(const struct device *dev, struct gpio_callback *cb_data, uint32_t pins)
+{
+    struct rad_rx_capture *capture = CONTAINER_OF(cb_data, struct rad_rx_capture, cb_data);
+
+#if CONFIG_PM_DEVICE
+    if (capture->suspended) {
+        return;
+    }
+#endif
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    if (capture->sleeping) {
+        /* Switching back to edges also stops the level interrupt from firing again. */
+        capture->sleeping = false;
+        rad_rx_capture_wake(capture, edges_enable(capture));
+        return;
+    }
+#endif
+
+    rad_rx_capture_edge(capture, timestamp_get(capture));
+}
+
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+void rad_rx_capture_sleep(struct rad_rx_capture *capture)
+{
+    /**
+     * A level interrupt is sensed through the PORT event which, unlike the GPIOTE IN event
+     * used for edges, doesn't keep HFCLK running. The interrupt is locked out so that an edge
+     * can't be mistaken for the wake before the pin has been switched over.
+     */
+    unsigned int key = irq_lock();
+
+#if CONFIG_PM_DEVICE
+    /* Edges were already disabled by the suspend. */
+    if (capture->suspended) {
+        irq_unlock(key);
+        return;
+    }
+#endif
+    if (!capture->sleeping) {
+        capture->sleeping = true;
+        edges_disable(capture, GPIO_INT_LEVEL_ACTIVE);
+    }
+    irq_unlock(key);
+}
+#endif
+
+#if CONFIG_PM_DEVICE
+int rad_rx_capture_suspend(struct rad_rx_capture *capture)
+{
+    capture->suspended = true;
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    if (capture->sleeping) {
+        /* Edges, and the TIMER, were already disabled when the receiver fell asleep. */
+        return gpio_pin_interrupt_configure(capture->port, capture->pin, GPIO_INT_DISABLE);
+    }
+#endif
+    edges_disable(capture, GPIO_INT_DISABLE);
+    return 0;
+}
+
+int rad_rx_capture_resume(struct rad_rx_capture *capture)
+{
+    capture->suspended = false;
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    /**
+     * Edges are disabled either way so this goes straight to level sense. Going through
+     * rad_rx_capture_sleep would stop the TIMER a second time.
+     */
+    capture->sleeping = true;
+    return gpio_pin_interrupt_configure(capture->port, capture->pin, GPIO_INT_LEVEL_ACTIVE);
+#else
+    edges_enable(capture);
+    return 0;
+#endif
+}
+#endif /* CONFIG_PM_DEVICE */
+
+bool rad_rx_capture_level_get(struct rad_rx_capture *capture)
+{
+    return (gpio_pin_get(capture->port, capture->pin) > 0);
+}
+
+int rad_rx_capture_init(struct rad_rx_capture *capture, const struct rad_rx_cfg *p_cfg)
+{
+    int err;
+
+    capture->pin  = p_cfg->pin;
+    capture->port = device_get_binding(p_cfg->port);
+#if CONFIG_PM_DEVICE
+    capture->suspended = false;
+#endif
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    capture->sleeping = false;
+#endif
+    if (!capture->port) {
+        return -ENODEV;
+    }
+
+    err = gpio_pin_configure(capture->port, p_cfg->pin, (GPIO_INPUT | p_cfg->flags));
+    if (err != 0) {
+        return err;
+    }
+
+    err = gpio_pin_interrupt_configure(capture->port, p_cfg->pin, GPIO_INT_EDGE_BOTH);
+    if (err != 0) {
+        return err;
+    }
+
+#if CONFIG_RAD_RX_CAPTURE_TIMER
+    err = rad_rx_capture_timer_init(capture, p_cfg);
+    if (err != 0) {
+        gpio_pin_interrupt_configure(capture->port, p_cfg->pin, GPIO_INT_DISABLE);
+        return err;
+    }
+#endif
+
+    gpio_init_callback(&capture->cb_data, input_changed, BIT(p_cfg->pin));
+    return gpio_add_callback(capture->port, &capture->cb_data);
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <kernel.h>
+#include <device.h>
+
+#include <drivers/rad_rx.h>
+
+#include "rad_rx_capture.h"
+
+/**
+ * There is no sensor. Edges are generated from pulse lists handed to rad_rx_sim_feed and
+ * timestamped with a simulated clock so decoding is exact and repeatable on any board,
+ * including native_posix.
+ */
+int rad_rx_capture_init(struct rad_rx_capture *capture, const struct rad_rx_cfg *p_cfg)
+{
+    capture->now       = 0;
+    capture->active    = false;
+    capture->suspended = false;
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    capture->sleeping  = false;
+#endif
+    return 0;
+}
+
+bool rad_rx_capture_level_get(struct rad_rx_capture *capture)
+{
+    return capture->active;
+}
+
+static void edge(struct rad_rx_capture *capture, bool active)
+{
+    capture->active = active;
+
+    if (capture->suspended) {
+        return;
+    }
+
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    if (capture->sleeping) {
+        if (active) {
+            capture->sleeping = false;
+            rad_rx_capture_wake(capture, capture->now);
+        }
+        return;
+    }
+#endif
+
+    rad_rx_capture_edge(capture, capture->now);
+}
+
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+void rad_rx_capture_sleep(struct rad_rx_capture *capture)
+{
+    /* Like a level interrupt, wakes up right away if the line is already active. */
+    capture->sleeping = !capture->active;
+    if (!capture->sleeping) {
+        rad_rx_capture_wake(capture, capture->now);
+    }
+}
+#endif
+
+#if CONFIG_PM_DEVICE
+int rad_rx_capture_suspend(struct rad_rx_capture *capture)
+{
+    capture->suspended = true;
+    return 0;
+}
+
+int rad_rx_capture_resume(struct rad_rx_capture *capture)
+{
+    capture->suspended = false;
+#if CONFIG_RAD_RX_WAKE_ON_LEVEL
+    rad_rx_capture_sleep(capture);
+#endif
+    return 0;
+}
+#endif /* CONFIG_PM_DEVICE */
+
+int rad_rx_sim_feed(const struct device *dev,
+                    uint32_t idle_us,
+                    const uint32_t *pulses_us,
+                    size_t len)
+{
+    struct rad_rx_capture *capture;
+
+    if ((dev == NULL) || ((pulses_us == NULL) && (len != 0))) {
+        return -EINVAL;
+    }
+
+    capture = rad_rx_capture_get(dev);
+
+    capture->now += RAD_RX_US_TO_TICKS_FLOOR(idle_us);
+    for (size_t i=0; i < len; i++) {
+        edge(capture, (0 == (i % 2)));
+        capture->now += RAD_RX_US_TO_TICKS_FLOOR(pulses_us[i]);
+    }
+
+    if (len % 2) {
+        /* End on an inactive edge so the last mark is measured. */
+        edge(capture, false);
+    }
+    return 0;
+}
+
+int rad_rx_sim_edge(const struct device *dev, uint32_t after_us)
+{
+    struct rad_rx_capture *capture;
+
+    if (dev == NULL) {
+        return -EINVAL;
+    }
+
+    capture = rad_rx_capture_get(dev);
+
+    capture->now += RAD_RX_US_TO_TICKS_FLOOR(after_us);
+    edge(capture, !capture->active);
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <kernel.h>
+#include <device.h>
+
+#include <hal/nrf_gpiote.h>
+#include <nrfx_ppi.h>
+#include <nrfx_timer.h>
+
+#include <logging/log.h>
+
+#include "rad_rx_capture.h"
+
+LOG_MODULE_DECLARE(rad_rx, CONFIG_RAD_RX_LOG_LEVEL);
+
+/**
+ * The GPIO driver still owns the pin and still calls back on every edge but the GPIOTE IN
+ * event that it configured for the pin is also connected through PPI to a capture task of a
+ * free-running 1 MHz TIMER. The TIMER latches the time of the edge when it happens and the
+ * callback only has to read it back before the next edge, which is at least one bit pulse
+ * later. Every receiver uses its own capture/compare register of the shared TIMER.
+ */
+#define TIMER_CC_NUM NRF_TIMER_CC_CHANNEL_COUNT(CONFIG_RAD_RX_CAPTURE_TIMER_INSTANCE)
+
+static const nrfx_timer_t m_timer = NRFX_TIMER_INSTANCE(CONFIG_RAD_RX_CAPTURE_TIMER_INSTANCE);
+static uint8_t            m_next_cc;
+static uint8_t            m_started; /* Receivers that are timing edges. */
+
+static void timer_handler(nrf_timer_event_t event_type, void *p_context)
+{
+    /* No TIMER interrupts are enabled. */
+}
+
+static int timer_init(void)
+{
+    nrfx_err_t          err;
+    nrfx_timer_config_t config = NRFX_TIMER_DEFAULT_CONFIG;
+
+    config.frequency = NRF_TIMER_FREQ_1MHz;
+    config.mode      = NRF_TIMER_MODE_TIMER;
+    config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+
+    err = nrfx_timer_init(&m_timer, &config, timer_handler);
+    if (NRFX_SUCCESS != err) {
+        LOG_ERR("nrfx_timer_init failed: %d", err);
+        return -EBUSY;
+    }
+    return 0;
+}
+
+static int gpiote_channel_find(uint32_t psel, uint32_t *channel)
+{
+    /* The GPIO driver picks the channel when the edge interrupt is configured. */
+    for (uint32_t i=0; i < GPIOTE_CH_NUM; i++) {
+        uint32_t mode = (NRF_GPIOTE->CONFIG[i] & GPIOTE_CONFIG_MODE_Msk) >> GPIOTE_CONFIG_MODE_Pos;
+
+        if ((GPIOTE_CONFIG_MODE_Event == mode) && (psel == nrf_gpiote_event_pin_get(NRF_GPIOTE, i))) {
+            *channel = i;
+            return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+int rad_rx_capture_timer_init(struct rad_rx_capture *capture, const struct rad_rx_cfg *p_cfg)
+{
+    int        err;
+    nrfx_err_t nrfx_err;
+    uint32_t   channel;
+
+    if (TIMER_CC_NUM <= m_next_cc) {
+        LOG_ERR("TIMER%d has no capture register left", CONFIG_RAD_RX_CAPTURE_TIMER_INSTANCE);
+        return -ENOMEM;
+    }
+
+    err = gpiote_channel_find(p_cfg->psel, &channel);
+    if (err != 0) {
+        /* The pin is sensed through PORT events, which can't be routed through PPI. */
+        LOG_ERR("No GPIOTE channel for pin %d", p_cfg->psel);
+        return -ENOTSUP;
+    }
+
+    if (0 == m_next_cc) {
+        err = timer_init();
+        if (err != 0) {
+            return err;
+        }
+    }
+
+    nrfx_err = nrfx_ppi_channel_alloc(&capture->ppi);
+    if (NRFX_SUCCESS != nrfx_err) {
+        LOG_ERR("nrfx_ppi_channel_alloc failed: %d", nrfx_err);
+        return -ENOMEM;
+    }
+
+    capture->cc   = m_next_cc++;
+    capture->psel = p_cfg->psel;
+
+    rad_rx_capture_timer_start(capture);
+    return 0;
+}
+
+uint32_t rad_rx_capture_timer_get(const struct rad_rx_capture *capture)
+{
+    return nrfx_timer_capture_get(&m_timer, capture->cc);
+}
+
+uint32_t rad_rx_capture_timer_start(struct rad_rx_capture *capture)
+{
+    unsigned int key = irq_lock();
+    uint32_t     channel;
+
+    if (0 == m_started++) {
+        nrfx_timer_enable(&m_timer);
+    }
+
+    /* The GPIO driver may pick another GPIOTE channel whenever the edge interrupt is enabled. */
+    if (0 == gpiote_channel_find(capture->psel, &channel)) {
+        nrfx_ppi_channel_assign(capture->ppi,
+                                nrf_gpiote_event_address_get(NRF_GPIOTE, nrf_gpiote_in_event_get(channel)),
+                                nrfx_timer_capture_task_address_get(&m_timer, capture->cc));
+        nrfx_ppi_channel_enable(capture->ppi);
+    }
+    irq_unlock(key);
+
+    return nrfx_timer_capture(&m_timer, capture->cc);
+}
+
+void rad_rx_capture_timer_stop(struct rad_rx_capture *capture)
+{
+    unsigned int key = irq_lock();
+
+    nrfx_ppi_channel_disable(capture->ppi);
+    if (0 == --m_started) {
+        /* Nobody is timing edges so the TIMER doesn't need to keep HFCLK running. */
+        nrfx_timer_disable(&m_timer);
+    }
+    irq_unlock(key);
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#define DT_DRV_COMPAT dmv_rad_rx_group
+
+#include <kernel.h>
+#include <device.h>
+#include <devicetree.h>
+
+#include <logging/log.h>
+
+#include <drivers/rad_rx_group.h>
+
+#include "rad_rx_internal.h"
+
+LOG_MODULE_DECLARE(rad_rx, CONFIG_RAD_RX_LOG_LEVEL);
+
+/**
+ * Every message reported by a receiver of the group is either merged into a pending message
+ * with the same contents or starts a new pending message. A pending message is delivered once
+ * the group's window has elapsed since it was first received. Receivers only report from the
+ * decoding workqueue, which also runs the flush, so none of this needs locking.
+ */
+struct pending {
+    bool           used;
+    rad_msg_type_t msg_type;
+    rad_msg_t      msg;
+    uint32_t       sensors;
+    int64_t        deadline;
+};
+
+struct rad_rx_group_data {
+    rad_rx_group_callback_t cb;
+    struct k_work_delayable flush;
+    struct pending          pending[CONFIG_RAD_RX_GROUP_MAX_PENDING];
+};
+
+struct rad_rx_group_cfg {
+    const char * const *sensors;
+    const uint8_t       num_sensors;
+    const uint32_t      window_ms;
+};
+
+static void pending_deliver(struct rad_rx_group_data *p_data, struct pending *pending)
+{
+    pending->used = false;
+
+    if (p_data->cb) {
+        struct rad_rx_delivery delivery = {
+            .group_cb  = p_data->cb,
+            .msg_type  = pending->msg_type,
+            .sensor_id = RAD_TRACE_ID_GROUP,
+            .sensors   = pending->sensors,
+            .msg       = pending->msg,
+        };
+
+        rad_rx_deliver(&delivery);
+    }
+}
+
+static void flush(struct k_work *item)
+{
+    struct k_work_delayable  *dwork  = k_work_delayable_from_work(item);
+    struct rad_rx_group_data *p_data = CONTAINER_OF(dwork, struct rad_rx_group_data, flush);
+
+    int64_t now  = k_uptime_get();
+    int64_t next = INT64_MAX;
+
+    for (int i=0; i < CONFIG_RAD_RX_GROUP_MAX_PENDING; i++) {
+        struct pending *pending = &p_data->pending[i];
+
+        if (!pending->used) {
+            continue;
+        }
+
+        if (pending->deadline <= now) {
+            pending_deliver(p_data, pending);
+        } else {
+            next = MIN(next, pending->deadline);
+        }
+    }
+
+    if (INT64_MAX != next) {
+        rad_rx_work_schedule(&p_data->flush, K_MSEC(next - now));
+    }
+}
+
+void rad_rx_group_report(const struct device *group,
+                         uint8_t sensor,
+                         rad_msg_type_t msg_type,
+                         const rad_msg_t *msg)
+{
+    struct rad_rx_group_data      *p_data = group->data;
+    const struct rad_rx_group_cfg *p_cfg  = group->config;
+    struct pending                *free   = NULL;
+    struct pending                *oldest = NULL;
+    size_t                         len    = rad_rx_msg_len(msg_type);
+
+    for (int i=0; i < CONFIG_RAD_RX_GROUP_MAX_PENDING; i++) {
+        struct pending *pending = &p_data->pending[i];
+
+        if (!pending->used) {
+            free = (free ? free : pending);
+            continue;
+        }
+
+        if ((pending->msg_type == msg_type) && (0 == memcmp(&pending->msg, msg, len))) {
+            if (0 == (pending->sensors & BIT(sensor))) {
+                pending->sensors |= BIT(sensor);
+                return;
+            }
+            /* The same receiver got the same message again so it's a new shot. */
+            pending_deliver(p_data, pending);
+            free = pending;
+            break;
+        }
+
+        if (!oldest || (pending->deadline < oldest->deadline)) {
+            oldest = pending;
+        }
+    }
+
+    if (!free) {
+        /* Make room by delivering the oldest message early. */
+        pending_deliver(p_data, oldest);
+        free = oldest;
+    }
+
+    free->used     = true;
+    free->msg_type = msg_type;
+    free->sensors  = BIT(sensor);
+    free->deadline = (k_uptime_get() + p_cfg->window_ms);
+    memcpy(&free->msg, msg, len);
+
+    /* Doesn't move an earlier flush that is already scheduled. */
+    rad_rx_work_schedule(&p_data->flush, K_MSEC(p_cfg->window_ms));
+}
+
+static int dmv_rad_rx_group_init(const struct device *dev)
+{
+    struct rad_rx_group_data      *p_data = dev->data;
+    const struct rad_rx_group_cfg *p_cfg  = dev->config;
+
+    k_work_init_delayable(&p_data->flush, flush);
+    p_data->cb = NULL;
+
+    for (int i=0; i < p_cfg->num_sensors; i++) {
+        const struct device *sensor = device_get_binding(p_cfg->sensors[i]);
+        int                  err;
+
+        if (!sensor) {
+            LOG_ERR("Group sensor %s not found", p_cfg->sensors[i]);
+            return -ENODEV;
+        }
+
+        err = rad_rx_group_attach(sensor, dev, i);
+        if (err != 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+static int dmv_rad_rx_group_set_callback(const struct device *dev, rad_rx_group_callback_t cb)
+{
+    struct rad_rx_group_data *p_data = dev->data;
+    p_data->cb = cb;
+    return 0;
+}
+
+static const struct rad_rx_group_driver_api rad_rx_group_driver_api = {
+    .set_callback = dmv_rad_rx_group_set_callback,
+};
+
+#define INST(num) DT_INST(num, dmv_rad_rx_group)
+
+#define RAD_RX_GROUP_SENSOR_LABEL(node_id, prop, idx) \
+    DT_PROP_BY_PHANDLE_IDX(node_id, prop, idx, label),
+
+#define RAD_RX_GROUP_DEVICE(n) \
+    BUILD_ASSERT(DT_PROP_LEN(INST(n), sensors) <= 32, "A group can have at most 32 sensors"); \
+    static const char * const rad_rx_group_sensors_##n[] = { \
+        DT_FOREACH_PROP_ELEM(INST(n), sensors, RAD_RX_GROUP_SENSOR_LABEL) \
+    }; \
+    static const struct rad_rx_group_cfg rad_rx_group_cfg_##n = { \
+        .sensors     = rad_rx_group_sensors_##n, \
+        .num_sensors = ARRAY_SIZE(rad_rx_group_sensors_##n), \
+        .window_ms   = DT_PROP(INST(n), window_ms), \
+    }; \
+    static struct rad_rx_group_data rad_rx_group_data_##n; \
+    DEVICE_DEFINE(rad_rx_group_##n, \
+                DT_LABEL(INST(n)), \
+                dmv_rad_rx_group_init, \
+                NULL, \
+                &rad_rx_group_data_##n, \
+                &rad_rx_group_cfg_##n, \
+                POST_KERNEL, \
+                CONFIG_RAD_RX_GROUP_INIT_PRIORITY, \
+                &rad_rx_group_driver_api);
+
+DT_INST_FOREACH_STATUS_OKAY(RAD_RX_GROUP_DEVICE)
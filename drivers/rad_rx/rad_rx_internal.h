@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#ifndef ZEPHYR_DRIVERS_RAD_RX_INTERNAL_H_
+#define ZEPHYR_DRIVERS_RAD_RX_INTERNAL_H_
+
+#include <kernel.h>
+#include <device.h>
+
+#include <drivers/rad_rx.h>
+#include <drivers/rad_rx_group.h>
+#include <rad_trace.h>
+
+/**
+ * A decoded message on its way to the application. Exactly one of the callbacks is set.
+ */
+struct rad_rx_delivery {
+    rad_rx_callback_t       cb;
+    rad_rx_group_callback_t group_cb;
+    rad_msg_type_t          msg_type;
+    uint8_t                 sensor_id; /* Receiver, or RAD_TRACE_ID_GROUP for group_cb. */
+    uint32_t                sensors;
+    rad_msg_t               msg;
+};
+
+/**
+ * @brief Number of bytes of a message that are compared to tell messages apart.
+ */
+static inline size_t rad_rx_msg_len(rad_msg_type_t msg_type)
+{
+    switch (msg_type) {
+#if CONFIG_RAD_MSG_TYPE_RAD
+    case RAD_MSG_TYPE_RAD:
+        return sizeof(rad_msg_rad_t);
+#endif
+#if CONFIG_RAD_MSG_TYPE_DYNASTY
+    case RAD_MSG_TYPE_DYNASTY:
+        return sizeof(rad_msg_dynasty_t);
+#endif
+#if CONFIG_RAD_MSG_TYPE_LASER_X
+    case RAD_MSG_TYPE_LASER_X:
+        return sizeof(rad_msg_laser_x_t);
+#endif
+#if CONFIG_RAD_MSG_TYPE_LEARNED
+    case RAD_MSG_TYPE_LEARNED:
+        return sizeof(rad_msg_learned_t);
+#endif
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Run the callback of a delivery, or queue it for the callback thread.
+ */
+void rad_rx_deliver(const struct rad_rx_delivery *delivery);
+
+/**
+ * @brief Schedule work on the workqueue that decodes received messages.
+ */
+int rad_rx_work_schedule(struct k_work_delayable *work, k_timeout_t delay);
+
+#if CONFIG_RAD_RX_GROUP
+/**
+ * @brief Report every message decoded by a receiver to a group.
+ *
+ * @param dev    The receiver.
+ * @param group  The group.
+ * @param sensor Position of the receiver in the group.
+ */
+int rad_rx_group_attach(const struct device *dev, const struct device *group, uint8_t sensor);
+
+/**
+ * @brief Called by an attached receiver, from the decoding workqueue, for every message.
+ */
+void rad_rx_group_report(const struct device *group,
+                         uint8_t sensor,
+                         rad_msg_type_t msg_type,
+                         const rad_msg_t *msg);
+#endif /* CONFIG_RAD_RX_GROUP */
+
+#endif /* ZEPHYR_DRIVERS_RAD_RX_INTERNAL_H_ */
@@ -14,8 +14,16 @@
 
 #include <hal/nrf_gpio.h>
 #include <logging/log.h>
+#include <pm/device.h>
+#if CONFIG_RAD_TX_STATS_SUBSYS
+#include <stats/stats.h>
+#endif
+#if CONFIG_PM_DEVICE_RUNTIME
+#include <pm/device_runtime.h>
+#endif
 
 #include <drivers/rad_rx.h>
+#include <rad_trace.h>
 
 LOG_MODULE_REGISTER(rad_tx, CONFIG_RAD_TX_LOG_LEVEL);
 
@@ -69,11 +77,127 @@ static pwm_periph_t m_avail_pwms[] = {
 
 #define NUM_AVAIL_PWMS (sizeof(m_avail_pwms)/sizeof(pwm_periph_t))
 
+/* Every PWM value is one carrier period of the 16 MHz PWM clock. */
+#define RAD_TX_VALUES_TO_US(values) \
+    ((uint32_t)(((uint64_t)(values) * RAD_TX_TICKS_PER_PERIOD) / 16))
+
+#if CONFIG_RAD_TX_STATS_SUBSYS
+STATS_SECT_START(rad_tx)
+STATS_SECT_ENTRY32(blasts)
+STATS_SECT_ENTRY32(values)
+STATS_SECT_ENTRY32(busy_waits)
+STATS_SECT_ENTRY32(wait_us)
+STATS_SECT_ENTRY32(airtime_us)
+STATS_SECT_ENTRY32(preemptions)
+STATS_SECT_END;
+
+STATS_NAME_START(rad_tx)
+STATS_NAME(rad_tx, blasts)
+STATS_NAME(rad_tx, values)
+STATS_NAME(rad_tx, busy_waits)
+STATS_NAME(rad_tx, wait_us)
+STATS_NAME(rad_tx, airtime_us)
+STATS_NAME(rad_tx, preemptions)
+STATS_NAME_END(rad_tx);
+
+#define STATS_GROUP_INCN(p_data, name, n) STATS_INCN((p_data)->stats_group, name, n)
+#else
+#define STATS_GROUP_INCN(p_data, name, n)
+#endif
+
+#if CONFIG_RAD_TX_ASYNC
+/* Silence after each queued blast so receivers see the next one as a separate frame. */
+#define RAD_TX_ASYNC_GAP_VALUES DIV_ROUND_UP(CONFIG_RAD_TX_ASYNC_GAP_US, RAD_TX_PWM_VALUE_LEN_US)
+
+/* One more slot than queued blasts holds the one that is playing so it can be queued again. */
+#define RAD_TX_ASYNC_SLOTS (CONFIG_RAD_TX_ASYNC_QUEUE_SIZE + 1)
+
+enum tx_request_state {
+    TX_REQUEST_FREE,
+    TX_REQUEST_QUEUED,
+    TX_REQUEST_PLAYING,
+};
+
+/* A blast queued with rad_tx_blast_async or rad_tx_blast_priority. */
+struct tx_request {
+    rad_msg_type_t        msg_type;
+    rad_msg_t             msg;
+    struct k_poll_signal *signal;
+    uint32_t              seq; /* Order of arrival, which breaks ties between equal priorities. */
+    uint8_t               priority;
+    uint8_t               flags;
+    enum tx_request_state state;
+};
+#endif
+
+#if CONFIG_RAD_TX_SLOTS
+/* A blast encoded ahead of time by rad_tx_slot_set. */
+struct tx_slot {
+    rad_run_t      runs[RAD_TX_MSG_MAX_RUNS];
+    uint32_t       len; /* 0 while the slot is empty. */
+    rad_msg_type_t msg_type;
+};
+#endif
+
+#define TX_STREAM_NO_HALF 0xFF
+
+/**
+ * Expands the runs of the blast that is playing into the two halves of the PWM buffer: a
+ * leading silence, the runs, then the silence after the frame.
+ */
+struct tx_stream {
+    const rad_run_t *p_run;          /* Next run of the frame. */
+    const rad_run_t *p_end;
+    uint32_t         left;           /* Values left in the current run. */
+    uint32_t         gap;            /* Values of silence after the frame, once it's reached. */
+    bool             active;         /* Level of the current run. */
+    bool             in_frame;       /* The current run belongs to the frame. */
+    uint8_t          frame_end_half; /* Half that holds the last value of the frame. */
+};
+
+#if CONFIG_RAD_TX_STATS
+#define STAT_ADD(p_data, name, n) do { \
+        (p_data)->stats.name += (n); \
+        STATS_GROUP_INCN(p_data, name, n); \
+    } while (0)
+#else
+#define STAT_ADD(p_data, name, n)
+#endif
+
 struct rad_tx_data {
+    const struct device    *dev;
     struct k_sem            sem;
-    nrf_pwm_values_common_t values[RAD_TX_MSG_MAX_LEN_PWM_VALUES];
-    uint32_t                len;
+    rad_run_t               runs[RAD_TX_MSG_MAX_RUNS];
+    const rad_run_t        *p_runs;   /* Played by tx_start: 'runs' or a slot. */
+    uint32_t                len;      /* Number of runs in 'p_runs'. */
+    rad_msg_type_t          msg_type; /* Type of the message in 'p_runs'. */
     bool                    ready;
+    struct tx_stream        stream;
+    nrf_pwm_values_common_t buf[2][CONFIG_RAD_TX_BUFFER_VALUES]; /* Played by EasyDMA. */
+#if CONFIG_RAD_TX_SLOTS
+    struct tx_slot          slots[CONFIG_RAD_TX_SLOTS];
+#endif
+#if CONFIG_RAD_TX_ASYNC
+    rad_tx_callback_t       cb;
+    struct k_spinlock       lock;    /* Protects the requests, 'playing' and 'preempting'. */
+    struct tx_request       requests[RAD_TX_ASYNC_SLOTS];
+    struct tx_request      *playing; /* Queued blast that is playing, NULL for a blocking one. */
+    uint32_t                seq;
+#endif
+#if CONFIG_RAD_TX_PREEMPT
+    bool                    preempting;   /* The PWM was told to stop 'playing' early. */
+    bool                    frame_played; /* Only the silence after the frame is left. */
+#endif
+#if CONFIG_RAD_TX_STATS
+    struct rad_tx_stats     stats; /* Only written while holding 'sem'. */
+#endif
+#if CONFIG_RAD_TX_STATS_SUBSYS
+    STATS_SECT_DECL(rad_tx) stats_group;
+#endif
+#if CONFIG_PM_DEVICE_RUNTIME
+    struct k_work           pm_work;
+    atomic_t                pm_puts; /* References dropped by tx_release, put by 'pm_work'. */
+#endif
 };
 
 struct rad_tx_cfg {
@@ -81,159 +205,691 @@ struct rad_tx_cfg {
     const uint8_t  pwm_index;
 };
 
+#if CONFIG_PM_DEVICE_RUNTIME
+static void pm_put_work(struct k_work *item)
+{
+    struct rad_tx_data *p_data = CONTAINER_OF(item, struct rad_tx_data, pm_work);
+
+    /* Suspending releases the PWM and its clock. */
+    for (atomic_val_t puts = atomic_set(&p_data->pm_puts, 0); puts > 0; puts--) {
+        pm_device_runtime_put(p_data->dev);
+    }
+}
+#endif
+
+static void tx_release(struct rad_tx_data *p_data)
+{
+    k_sem_give(&p_data->sem);
+#if CONFIG_PM_DEVICE_RUNTIME
+    /**
+     * Also called from the PWM ISR, where the PM lock can't be taken. The reference is dropped
+     * from the system work queue instead; counting the drops means a blast that ends before
+     * the work item runs still gets its own put.
+     */
+    atomic_inc(&p_data->pm_puts);
+    k_work_submit(&p_data->pm_work);
+#endif
+}
+
+static bool stream_run_next(struct tx_stream *stream)
+{
+    if (stream->p_run < stream->p_end) {
+        stream->active   = (0 != (*stream->p_run & RAD_RUN_ACTIVE));
+        stream->left     = RAD_RUN_LEN(*stream->p_run);
+        stream->in_frame = true;
+        stream->p_run++;
+        return true;
+    }
+
+    if (stream->gap) {
+        stream->active   = false;
+        stream->left     = stream->gap;
+        stream->in_frame = false;
+        stream->gap      = 0;
+        return true;
+    }
+    return false;
+}
+
+static uint16_t stream_fill(struct rad_tx_data *p_data, uint8_t half)
+{
+    /**
+     * Writes the next values of the blast into one half of the buffer, before the PWM starts
+     * or while it plays the other half. Once the blast is over a single inactive value is
+     * written since a sequence can't be empty.
+     *
+     * @return Number of values written.
+     */
+    struct tx_stream        *stream   = &p_data->stream;
+    nrf_pwm_values_common_t *p_values = p_data->buf[half];
+    uint16_t                 len      = 0;
+
+    while (len < CONFIG_RAD_TX_BUFFER_VALUES) {
+        nrf_pwm_values_common_t value;
+        uint32_t                count;
+
+        if ((0 == stream->left) && !stream_run_next(stream)) {
+            break;
+        }
+
+        value = (stream->active ? RAD_TX_DUTY_CYCLE_50 : RAD_TX_DUTY_CYCLE_0);
+        count = MIN(stream->left, (uint32_t)(CONFIG_RAD_TX_BUFFER_VALUES - len));
+
+        stream->left -= count;
+        while (count--) {
+            p_values[len++] = value;
+        }
+
+        if (stream->in_frame && (0 == stream->left) && (stream->p_run == stream->p_end)) {
+            stream->in_frame       = false;
+            stream->frame_end_half = half;
+        }
+    }
+
+    if (0 == len) {
+        p_values[len++] = RAD_TX_DUTY_CYCLE_0;
+    }
+    return len;
+}
+
+static void stream_seq_end(struct rad_tx_data *p_data, nrfx_pwm_t *pwm_inst, uint8_t half)
+{
+    /* The PWM moved on to the other half so this one can be refilled. */
+#if CONFIG_RAD_TX_PREEMPT
+    if (half == p_data->stream.frame_end_half) {
+        p_data->frame_played = true;
+    }
+#endif
+    nrf_pwm_seq_cnt_set(pwm_inst->p_registers, half, stream_fill(p_data, half));
+}
+
+static void tx(nrfx_pwm_t *pwm_inst, struct rad_tx_data *p_data, uint32_t len)
+{
+    /**
+     * The PWM plays the two halves one after the other as a loop and stops by itself after
+     * the last loop that is needed for 'len' values. The half that comes after the last value
+     * is a single inactive value.
+     */
+    static nrf_pwm_sequence_t seq[2] = {
+        { .repeats = 0, .end_delay = 0 },
+        { .repeats = 0, .end_delay = 0 },
+    };
+    uint32_t loops = DIV_ROUND_UP(DIV_ROUND_UP(len, CONFIG_RAD_TX_BUFFER_VALUES), 2);
+
+    for (uint8_t i=0; i < ARRAY_SIZE(seq); i++) {
+        seq[i].values.p_common = p_data->buf[i];
+        seq[i].length          = stream_fill(p_data, i);
+    }
+
+    nrfx_pwm_complex_playback(pwm_inst,
+                              &seq[0],
+                              &seq[1],
+                              MAX(loops, 1),
+                              (NRFX_PWM_FLAG_STOP |
+                               NRFX_PWM_FLAG_SIGNAL_END_SEQ0 |
+                               NRFX_PWM_FLAG_SIGNAL_END_SEQ1 |
+                               NRFX_PWM_FLAG_NO_EVT_FINISHED));
+}
+
+#if CONFIG_RAD_TX_ASYNC
+static void request_done(struct rad_tx_data *p_data,
+                         rad_msg_type_t msg_type,
+                         struct k_poll_signal *signal,
+                         int result)
+{
+    if (signal) {
+        k_poll_signal_raise(signal, result);
+    }
+    if (p_data->cb) {
+        p_data->cb(p_data->dev, msg_type, result);
+    }
+}
+#endif
+
+static void tx_start(const struct device *dev, uint32_t lead_delay, uint32_t end_delay)
+{
+    /* 'lead_delay' and 'end_delay' are the silences before and after the frame in PWM values. */
+    const struct rad_tx_cfg *p_cfg  = dev->config;
+    struct rad_tx_data      *p_data = dev->data;
+    struct tx_stream        *stream = &p_data->stream;
+    uint32_t                 len    = 0;
+
+    for (uint32_t i=0; i < p_data->len; i++) {
+        len += RAD_RUN_LEN(p_data->p_runs[i]);
+    }
+
+    stream->p_run          = p_data->p_runs;
+    stream->p_end          = (p_data->p_runs + p_data->len);
+    stream->left           = lead_delay;
+    stream->gap            = end_delay;
+    stream->active         = false;
+    stream->in_frame       = false;
+    stream->frame_end_half = TX_STREAM_NO_HALF;
+
+#if CONFIG_RAD_TX_PREEMPT
+    p_data->frame_played = false;
+#endif
+    STAT_ADD(p_data, blasts, 1);
+    STAT_ADD(p_data, values, len);
+    STAT_ADD(p_data, airtime_us, RAD_TX_VALUES_TO_US(len));
+    sys_trace_rad_tx_start(p_cfg->pwm_index, p_data->msg_type);
+
+    tx(&m_avail_pwms[p_cfg->pwm_index].pwm_instance, p_data, (lead_delay + len + end_delay));
+}
+
+#if CONFIG_RAD_TX_ASYNC || CONFIG_RAD_TX_SLOTS
+static const struct rad_protocol *protocol_get(rad_msg_type_t msg_type)
+{
+    switch (msg_type) {
+#if CONFIG_RAD_TX_RAD
+    case RAD_MSG_TYPE_RAD:
+        return &rad_msg_type_rad_protocol;
+#endif
+#if CONFIG_RAD_TX_LASER_X
+    case RAD_MSG_TYPE_LASER_X:
+        return &rad_msg_type_laser_x_protocol;
+#endif
+#if CONFIG_RAD_TX_DYNASTY
+    case RAD_MSG_TYPE_DYNASTY:
+        return &rad_msg_type_dynasty_protocol;
+#endif
+    default:
+        return NULL;
+    }
+}
+#endif
+
+#if CONFIG_RAD_TX_ASYNC
+static struct tx_request *request_take(struct rad_tx_data *p_data)
+{
+    /* Takes the queued blast with the highest priority, the oldest one among equals. */
+    struct tx_request *next = NULL;
+    k_spinlock_key_t   key  = k_spin_lock(&p_data->lock);
+
+    for (int i=0; i < RAD_TX_ASYNC_SLOTS; i++) {
+        struct tx_request *request = &p_data->requests[i];
+
+        if (TX_REQUEST_QUEUED != request->state) {
+            continue;
+        }
+        if ((NULL == next) ||
+            (next->priority < request->priority) ||
+            ((next->priority == request->priority) && ((int32_t)(request->seq - next->seq) < 0))) {
+            next = request;
+        }
+    }
+
+    if (next) {
+        next->state = TX_REQUEST_PLAYING;
+    }
+    k_spin_unlock(&p_data->lock, key);
+    return next;
+}
+
+static void request_free(struct rad_tx_data *p_data, struct tx_request *request, int result)
+{
+    rad_msg_type_t        msg_type = request->msg_type;
+    struct k_poll_signal *signal   = request->signal;
+    k_spinlock_key_t      key      = k_spin_lock(&p_data->lock);
+
+    request->state = TX_REQUEST_FREE;
+    k_spin_unlock(&p_data->lock, key);
+
+    request_done(p_data, msg_type, signal, result);
+}
+
+static bool request_next(struct rad_tx_data *p_data, uint32_t lead_delay)
+{
+    /**
+     * Starts the most urgent queued blast. Only called while holding 'sem': from the PWM ISR
+     * when a blast ends, or by rad_tx_blast_async when the transmitter was idle. Messages were
+     * checked when they were queued so encoding only fails if the buffer is too small.
+     */
+    struct tx_request *request;
+
+    while (NULL != (request = request_take(p_data))) {
+        k_spinlock_key_t key;
+        uint32_t         len = RAD_TX_MSG_MAX_RUNS;
+        int              err = rad_protocol_encode(protocol_get(request->msg_type),
+                                                   &request->msg,
+                                                   p_data->runs,
+                                                   &len);
+        if (err) {
+            p_data->len = 0;
+            request_free(p_data, request, err);
+            continue;
+        }
+
+        /* Started under the lock so a preempting blast never sees a blast that isn't playing. */
+        key              = k_spin_lock(&p_data->lock);
+        p_data->p_runs   = p_data->runs;
+        p_data->len      = len;
+        p_data->msg_type = request->msg_type;
+        p_data->playing  = request;
+        tx_start(p_data->dev, lead_delay, RAD_TX_ASYNC_GAP_VALUES);
+        k_spin_unlock(&p_data->lock, key);
+        return true;
+    }
+    return false;
+}
+
+static bool request_end(struct rad_tx_data *p_data)
+{
+    /**
+     * Reports the end of the queued blast that was playing, if any. Called from the PWM ISR.
+     *
+     * @return true if the line hasn't been clear for CONFIG_RAD_TX_ASYNC_GAP_US: the blast was
+     *         cut short, or it was a blocking blast, which isn't followed by any silence.
+     */
+    struct tx_request *request;
+    bool               blocking;
+    bool               preempted = false;
+    k_spinlock_key_t   key       = k_spin_lock(&p_data->lock);
+
+    request         = p_data->playing;
+    blocking        = (NULL == request);
+    p_data->playing = NULL;
+#if CONFIG_RAD_TX_PREEMPT
+    /* Stopping during the silence after the frame doesn't cut it. */
+    preempted          = (p_data->preempting && !p_data->frame_played);
+    p_data->preempting = false;
+
+    if (preempted && (request->flags & RAD_TX_FLAG_REQUEUE)) {
+        /* Keeps its place ahead of the blasts of the same priority that were queued after it. */
+        request->state = TX_REQUEST_QUEUED;
+        request        = NULL;
+    }
+#endif
+    k_spin_unlock(&p_data->lock, key);
+
+    if (preempted) {
+        STAT_ADD(p_data, preemptions, 1);
+    }
+    if (request) {
+        request_free(p_data, request, (preempted ? -ECANCELED : 0));
+    }
+    return (preempted || blocking);
+}
+
+static void request_cancel_all(struct rad_tx_data *p_data, int result)
+{
+    struct tx_request *request;
+
+    while (NULL != (request = request_take(p_data))) {
+        request_free(p_data, request, result);
+    }
+}
+#endif /* CONFIG_RAD_TX_ASYNC */
+
+static void tx_finish(struct rad_tx_data *p_data, uint32_t lead_delay)
+{
+    /**
+     * Hands the PWM to the next queued blast, if there is one, or gives it up. 'lead_delay' is
+     * the silence before the next queued blast, for when the previous one was cut short.
+     */
+#if CONFIG_RAD_TX_ASYNC
+    if (request_next(p_data, lead_delay)) {
+        return;
+    }
+#else
+    ARG_UNUSED(lead_delay);
+#endif
+    tx_release(p_data);
+}
+
 static void pwm_handler(nrfx_pwm_evt_type_t event_type, void *p_context)
 {
-    struct rad_tx_data *p_data = (struct rad_tx_data*)p_context;
+    struct rad_tx_data *p_data     = (struct rad_tx_data*)p_context;
+    nrfx_pwm_t         *pwm_inst   =
+        &m_avail_pwms[((const struct rad_tx_cfg *)p_data->dev->config)->pwm_index].pwm_instance;
+    uint32_t            lead_delay = 0;
 
     switch (event_type) {
+    case NRFX_PWM_EVT_END_SEQ0:
+        stream_seq_end(p_data, pwm_inst, 0);
+        break;
+    case NRFX_PWM_EVT_END_SEQ1:
+        stream_seq_end(p_data, pwm_inst, 1);
+        break;
     case NRFX_PWM_EVT_STOPPED:
-        k_sem_give(&p_data->sem);
+        sys_trace_rad_tx_stopped(((const struct rad_tx_cfg *)p_data->dev->config)->pwm_index,
+                                 p_data->msg_type);
+#if CONFIG_RAD_TX_ASYNC
+        if (request_end(p_data)) {
+            /* The receivers have to see the line clear before the next frame starts. */
+            lead_delay = RAD_TX_ASYNC_GAP_VALUES;
+        }
+#endif
+        /* Queued blasts are chained before a blocking blast can take the PWM. */
+        tx_finish(p_data, lead_delay);
         break;
     default:
         break;
     }
 }
 
-static void tx(nrfx_pwm_t *pwm_inst, const nrf_pwm_values_common_t *values, uint32_t len)
+static int sem_take(struct rad_tx_data *p_data, k_timeout_t timeout)
 {
-    static nrf_pwm_sequence_t seq = {
-        .values.p_common = NULL,
-        .length          = 0,
-        .repeats         = 0,
-        .end_delay       = 0,
-        .repeats         = 0
-    };
+#if CONFIG_RAD_TX_STATS
+    uint32_t start;
+    int      err;
 
-    seq.values.p_common = values;
-    seq.length          = len;
+    if (0 == k_sem_take(&p_data->sem, K_NO_WAIT)) {
+        return 0;
+    }
+    if (K_TIMEOUT_EQ(timeout, K_NO_WAIT)) {
+        return -EBUSY;
+    }
 
-    nrfx_pwm_simple_playback(pwm_inst, &seq, 1, NRFX_PWM_FLAG_STOP);
+    /* The previous blast is still playing. */
+    start = k_cycle_get_32();
+    err   = k_sem_take(&p_data->sem, timeout);
+    if (0 == err) {
+        STAT_ADD(p_data, busy_waits, 1);
+        STAT_ADD(p_data, wait_us, k_cyc_to_us_floor32(k_cycle_get_32() - start));
+    }
+    return err;
+#else
+    return k_sem_take(&p_data->sem, timeout);
+#endif
 }
 
-#if CONFIG_RAD_TX_RAD
-static int dmv_rad_tx_rad_blast(const struct device *dev, const rad_msg_rad_t *msg)
+static int tx_power_get(const struct device *dev)
 {
-    const struct rad_tx_cfg *p_cfg  = dev->config;
-    struct rad_tx_data      *p_data = dev->data;
+#if CONFIG_PM_DEVICE
+    struct rad_tx_data *p_data = dev->data;
+    int                 err    = 0;
+
+#if CONFIG_PM_DEVICE_RUNTIME
+    err = pm_device_runtime_get(dev);
+    if (err < 0) {
+        k_sem_give(&p_data->sem);
+    } else {
+        err = 0;
+    }
+#endif
+    if ((0 == err) && !m_avail_pwms[((const struct rad_tx_cfg *)dev->config)->pwm_index].ready) {
+        /* Suspended and not managed by runtime PM. */
+        tx_release(p_data);
+        err = -EBUSY;
+    }
+#if CONFIG_RAD_TX_ASYNC
+    if (0 != err) {
+        /* No blast will end to start the queued ones. */
+        request_cancel_all(p_data, err);
+    }
+#endif
+    return err;
+#else
+    return 0;
+#endif
+}
+
+static int tx_acquire(const struct device *dev, k_timeout_t timeout)
+{
+    struct rad_tx_data *p_data = dev->data;
+    int                 err;
+
+    err = sem_take(p_data, timeout);
+    if (0 != err) {
+        return err;
+    }
+    return tx_power_get(dev);
+}
+
+static int blast(const struct device *dev, const struct rad_protocol *protocol, const void *msg)
+{
+    struct rad_tx_data *p_data = dev->data;
+    uint32_t            len    = RAD_TX_MSG_MAX_RUNS;
 
     if (unlikely(!p_data->ready)) {
         LOG_ERR("Driver is not initialized");
         return -EBUSY;
     }
 
-    int err = k_sem_take(&p_data->sem, K_FOREVER);
+    int err = tx_acquire(dev, K_FOREVER);
     if (0 != err) {
         return err;
     }
 
-    p_data->len = RAD_TX_MSG_MAX_LEN_PWM_VALUES;
-
-    err = rad_msg_type_rad_encode(msg, p_data->values, &p_data->len);
+    err = rad_protocol_encode(protocol, msg, p_data->runs, &len);
     if (err) {
+        p_data->len = 0;
+        tx_finish(p_data, 0);
         return err;
     }
-    tx(&m_avail_pwms[p_cfg->pwm_index].pwm_instance, p_data->values, p_data->len);
+    p_data->p_runs   = p_data->runs;
+    p_data->len      = len;
+    p_data->msg_type = protocol->msg_type;
+
+    tx_start(dev, 0, 0);
     return 0;
 }
+
+#if CONFIG_RAD_TX_RAD
+static int dmv_rad_tx_rad_blast(const struct device *dev, const rad_msg_rad_t *msg)
+{
+    return blast(dev, &rad_msg_type_rad_protocol, msg);
+}
 #endif /* CONFIG_RAD_TX_RAD */
 
 #if CONFIG_RAD_TX_LASER_X
 static int dmv_rad_tx_laser_x_blast(const struct device *dev, const rad_msg_laser_x_t *msg)
 {
-    const struct rad_tx_cfg *p_cfg  = dev->config;
-    struct rad_tx_data      *p_data = dev->data;
+    return blast(dev, &rad_msg_type_laser_x_protocol, msg);
+}
+#endif /* CONFIG_RAD_TX_LASER_X */
+
+#if CONFIG_RAD_TX_DYNASTY
+static int dmv_rad_tx_dynasty_blast(const struct device *dev, const rad_msg_dynasty_t *msg)
+{
+    return blast(dev, &rad_msg_type_dynasty_protocol, msg);
+}
+#endif /* CONFIG_RAD_TX_DYNASTY */
+
+static int dmv_rad_tx_blast_again(const struct device *dev)
+{
+    struct rad_tx_data *p_data = dev->data;
 
     if (unlikely(!p_data->ready)) {
         LOG_ERR("Driver is not initialized");
         return -EBUSY;
     }
 
-    int err = k_sem_take(&p_data->sem, K_FOREVER);
-    if (0 != err) {
-        return err;
+    if (0 == p_data->len) {
+        return -1;
     }
 
-    p_data->len = RAD_TX_MSG_MAX_LEN_PWM_VALUES;
-
-    err = rad_msg_type_laser_x_encode(msg, p_data->values, &p_data->len);
-    if (err) {
+    int err = tx_acquire(dev, K_FOREVER);
+    if (0 != err) {
         return err;
     }
-    tx(&m_avail_pwms[p_cfg->pwm_index].pwm_instance, p_data->values, p_data->len);
+    tx_start(dev, 0, 0);
     return 0;
 }
-#endif /* CONFIG_RAD_TX_LASER_X */
 
-#if CONFIG_RAD_TX_DYNASTY
-static int dmv_rad_tx_dynasty_blast(const struct device *dev, const rad_msg_dynasty_t *msg)
+#if CONFIG_RAD_TX_SLOTS
+static int dmv_rad_tx_slot_set(const struct device *dev,
+                               uint8_t slot,
+                               rad_msg_type_t msg_type,
+                               const rad_msg_t *msg)
 {
-    const struct rad_tx_cfg *p_cfg  = dev->config;
-    struct rad_tx_data      *p_data = dev->data;
+    struct rad_tx_data        *p_data   = dev->data;
+    const struct rad_protocol *protocol = protocol_get(msg_type);
+    uint32_t                   len      = RAD_TX_MSG_MAX_RUNS;
+    int                        err;
 
     if (unlikely(!p_data->ready)) {
         LOG_ERR("Driver is not initialized");
         return -EBUSY;
     }
 
-    int err = k_sem_take(&p_data->sem, K_FOREVER);
-    if (0 != err) {
-        return err;
+    if (CONFIG_RAD_TX_SLOTS <= slot) {
+        return -EINVAL;
     }
 
-    p_data->len = RAD_TX_MSG_MAX_LEN_PWM_VALUES;
+    if (NULL == protocol) {
+        return -ENOTSUP;
+    }
 
-    err = rad_msg_type_dynasty_encode(msg, p_data->values, &p_data->len);
-    if (err) {
-        return err;
+    /* The slot may be playing. Encoding doesn't need the PWM so it isn't resumed. */
+    k_sem_take(&p_data->sem, K_FOREVER);
+    err = rad_protocol_encode(protocol, msg, p_data->slots[slot].runs, &len);
+    p_data->slots[slot].len      = (err ? 0 : len);
+    p_data->slots[slot].msg_type = msg_type;
+    if (p_data->p_runs == p_data->slots[slot].runs) {
+        /* rad_tx_blast_again repeats the slot as it is now. */
+        p_data->len      = p_data->slots[slot].len;
+        p_data->msg_type = msg_type;
     }
-    tx(&m_avail_pwms[p_cfg->pwm_index].pwm_instance, p_data->values, p_data->len);
-    return 0;
+#if CONFIG_RAD_TX_ASYNC
+    /**
+     * A blast queued in the meantime found the transmitter busy and waits for the PWM ISR,
+     * which isn't coming. The transmitter is handed on the same way a blast that ends does.
+     */
+    if (0 == tx_power_get(dev)) {
+        tx_finish(p_data, 0);
+    }
+#else
+    k_sem_give(&p_data->sem);
+#endif
+    return err;
 }
-#endif /* CONFIG_RAD_TX_DYNASTY */
 
-static int dmv_rad_tx_blast_again(const struct device *dev)
+static int dmv_rad_tx_slot_blast(const struct device *dev, uint8_t slot)
 {
-    const struct rad_tx_cfg *p_cfg  = dev->config;
-    struct rad_tx_data      *p_data = dev->data;
+    struct rad_tx_data *p_data = dev->data;
+    int                 err;
 
     if (unlikely(!p_data->ready)) {
         LOG_ERR("Driver is not initialized");
         return -EBUSY;
     }
 
-    if (0 == p_data->len) {
-        return -1;
+    if (CONFIG_RAD_TX_SLOTS <= slot) {
+        return -EINVAL;
     }
 
-    int err = k_sem_take(&p_data->sem, K_FOREVER);
+    err = tx_acquire(dev, K_FOREVER);
     if (0 != err) {
         return err;
     }
-    tx(&m_avail_pwms[p_cfg->pwm_index].pwm_instance, p_data->values, p_data->len);
+
+    if (0 == p_data->slots[slot].len) {
+        tx_finish(p_data, 0);
+        return -ENOENT;
+    }
+
+    /* Played straight from the slot so nothing is encoded and the scratch buffer is left alone. */
+    p_data->p_runs   = p_data->slots[slot].runs;
+    p_data->len      = p_data->slots[slot].len;
+    p_data->msg_type = p_data->slots[slot].msg_type;
+
+    tx_start(dev, 0, 0);
     return 0;
 }
+#endif /* CONFIG_RAD_TX_SLOTS */
 
-static int dmv_rad_tx_init(const struct device *dev)
+#if CONFIG_RAD_TX_ASYNC
+static int dmv_rad_tx_blast_async(const struct device *dev,
+                                  rad_msg_type_t msg_type,
+                                  const rad_msg_t *msg,
+                                  uint8_t priority,
+                                  uint8_t flags,
+                                  struct k_poll_signal *signal)
 {
-    nrfx_pwm_t *p_inst;
+    struct rad_tx_data        *p_data   = dev->data;
+    const struct rad_protocol *protocol = protocol_get(msg_type);
+    struct tx_request         *slot     = NULL;
+    int                        queued   = 0;
+    uint32_t                   fields[RAD_PROTOCOL_MAX_FIELDS];
+    k_spinlock_key_t           key;
 
-    const struct rad_tx_cfg *p_cfg  = dev->config;
-    struct rad_tx_data      *p_data = dev->data;
+    if (unlikely(!p_data->ready)) {
+        LOG_ERR("Driver is not initialized");
+        return -EBUSY;
+    }
 
-    if (unlikely(p_data->ready)) {
-        /* Already initialized */
-        return 0;
+    if (NULL == protocol) {
+        return -ENOTSUP;
     }
 
-    if (NUM_AVAIL_PWMS <= p_cfg->pwm_index) {
-        goto ERR_EXIT;
+    if (0 != protocol->pack(msg, fields)) {
+        return -EINVAL;
     }
 
-    if (0 != k_sem_init(&p_data->sem, 1, 1)) {
-        goto ERR_EXIT;
+    key = k_spin_lock(&p_data->lock);
+    for (int i=0; i < RAD_TX_ASYNC_SLOTS; i++) {
+        if (TX_REQUEST_QUEUED == p_data->requests[i].state) {
+            queued++;
+        } else if ((TX_REQUEST_FREE == p_data->requests[i].state) && (NULL == slot)) {
+            slot = &p_data->requests[i];
+        }
+    }
+
+    if ((CONFIG_RAD_TX_ASYNC_QUEUE_SIZE <= queued) || (NULL == slot)) {
+        k_spin_unlock(&p_data->lock, key);
+        return -ENOMEM;
+    }
+
+    slot->msg_type = msg_type;
+    slot->msg      = *msg;
+    slot->signal   = signal;
+    slot->seq      = p_data->seq++;
+    slot->priority = priority;
+    slot->flags    = flags;
+    slot->state    = TX_REQUEST_QUEUED;
+
+#if CONFIG_RAD_TX_PREEMPT
+    if ((NULL != p_data->playing) &&
+        (p_data->playing->priority < priority) &&
+        !p_data->preempting &&
+        !p_data->frame_played) {
+        /**
+         * The PWM stops at the end of the current carrier period so the last pulse isn't
+         * shortened, and its ISR starts this blast after the line clear time.
+         */
+        const struct rad_tx_cfg *p_cfg = dev->config;
+
+        p_data->preempting = true;
+        nrfx_pwm_stop(&m_avail_pwms[p_cfg->pwm_index].pwm_instance, false);
+    }
+#endif
+    k_spin_unlock(&p_data->lock, key);
+
+    if (0 != sem_take(p_data, K_NO_WAIT)) {
+        /* A blast is playing. The PWM ISR starts this one once the more urgent ones have ended. */
+        return 0;
+    }
+
+    if (0 == tx_power_get(dev)) {
+        tx_finish(p_data, 0);
     }
+    return 0;
+}
+
+static int dmv_rad_tx_set_callback(const struct device *dev, rad_tx_callback_t cb)
+{
+    struct rad_tx_data *p_data = dev->data;
+    p_data->cb = cb;
+    return 0;
+}
+#endif /* CONFIG_RAD_TX_ASYNC */
+
+#if CONFIG_RAD_TX_STATS
+static int dmv_rad_tx_stats_get(const struct device *dev, struct rad_tx_stats *stats)
+{
+    struct rad_tx_data *p_data = dev->data;
+
+    *stats = p_data->stats;
+    return 0;
+}
+#endif
 
-    p_inst = &m_avail_pwms[p_cfg->pwm_index].pwm_instance;
+static int pwm_setup(const struct device *dev)
+{
+    const struct rad_tx_cfg *p_cfg  = dev->config;
+    struct rad_tx_data      *p_data = dev->data;
 
     if (!m_avail_pwms[p_cfg->pwm_index].ready) {
         nrfx_pwm_config_t config = NRFX_PWM_DEFAULT_CONFIG(p_cfg->pin,
@@ -244,19 +900,12 @@ static int dmv_rad_tx_init(const struct device *dev)
         config.top_value  = RAD_TX_TICKS_PER_PERIOD;
         config.load_mode  = NRF_PWM_LOAD_COMMON;
 
-        /* NOTE: irq_connect_dynamic returns a vector index instead of an error code. */
-        irq_connect_dynamic(m_avail_pwms[p_cfg->pwm_index].irq_p,
-                              m_avail_pwms[p_cfg->pwm_index].priority_p,
-                              nrfx_isr,
-                              m_avail_pwms[p_cfg->pwm_index].isr_p,
-                              0);
-
         nrfx_err_t err = nrfx_pwm_init(&m_avail_pwms[p_cfg->pwm_index].pwm_instance,
                                          &config,
                                          pwm_handler,
                                          p_data);
         if (NRFX_SUCCESS != err) {
-            goto ERR_EXIT;
+            return -ENXIO;
         }
 
         m_avail_pwms[p_cfg->pwm_index].ready = true;
@@ -265,22 +914,147 @@ static int dmv_rad_tx_init(const struct device *dev)
     nrf_gpio_pin_clear(p_cfg->pin);
     nrf_gpio_cfg_output(p_cfg->pin);
     m_avail_pwms[p_cfg->pwm_index].pwm_instance.p_registers->PSEL.OUT[0] = p_cfg->pin;
+    return 0;
+}
+
+static int dmv_rad_tx_init(const struct device *dev)
+{
+    const struct rad_tx_cfg *p_cfg  = dev->config;
+    struct rad_tx_data      *p_data = dev->data;
+
+    if (unlikely(p_data->ready)) {
+        /* Already initialized */
+        return 0;
+    }
+
+    if (NUM_AVAIL_PWMS <= p_cfg->pwm_index) {
+        goto ERR_EXIT;
+    }
+
+    if (0 != k_sem_init(&p_data->sem, 1, 1)) {
+        goto ERR_EXIT;
+    }
+
+    /* Set before anything can call pwm_handler. */
+    p_data->dev = dev;
 
-    p_data->len   = 0;
-    p_data->ready = true;
+    if (!m_avail_pwms[p_cfg->pwm_index].ready) {
+        /* NOTE: irq_connect_dynamic returns a vector index instead of an error code. */
+        irq_connect_dynamic(m_avail_pwms[p_cfg->pwm_index].irq_p,
+                              m_avail_pwms[p_cfg->pwm_index].priority_p,
+                              nrfx_isr,
+                              m_avail_pwms[p_cfg->pwm_index].isr_p,
+                              0);
+    }
+
+    if (0 != pwm_setup(dev)) {
+        goto ERR_EXIT;
+    }
+
+#if CONFIG_RAD_TX_STATS
+    memset(&p_data->stats, 0, sizeof(p_data->stats));
+#endif
+#if CONFIG_RAD_TX_STATS_SUBSYS
+    if (0 != stats_init_and_reg(STATS_HDR(p_data->stats_group),
+                                STATS_SIZE_INIT_PARMS(p_data->stats_group, STATS_SIZE_32),
+                                STATS_NAME_INIT_PARMS(rad_tx),
+                                dev->name)) {
+        /* The driver's own counters still work. */
+        LOG_WRN("Stats group registration failed");
+    }
+#endif
+
+#if CONFIG_RAD_TX_ASYNC
+    memset(p_data->requests, 0, sizeof(p_data->requests));
+    p_data->cb      = NULL;
+    p_data->playing = NULL;
+    p_data->seq     = 0;
+#endif
+#if CONFIG_RAD_TX_PREEMPT
+    p_data->preempting   = false;
+    p_data->frame_played = false;
+#endif
+
+#if CONFIG_RAD_TX_SLOTS
+    memset(p_data->slots, 0, sizeof(p_data->slots));
+#endif
+
+    p_data->p_runs   = p_data->runs;
+    p_data->len      = 0;
+    p_data->ready    = true;
+
+#if CONFIG_PM_DEVICE_RUNTIME
+    /* Only resumed while a blast is playing. */
+    k_work_init(&p_data->pm_work, pm_put_work);
+    atomic_set(&p_data->pm_puts, 0);
+    pm_device_runtime_enable(dev);
+#endif
     return 0;
 
 ERR_EXIT:
     return -ENXIO;
 }
 
+#if CONFIG_PM_DEVICE
+static int dmv_rad_tx_pm_action(const struct device *dev, enum pm_device_action action)
+{
+    const struct rad_tx_cfg *p_cfg  = dev->config;
+#if !CONFIG_PM_DEVICE_RUNTIME
+    struct rad_tx_data      *p_data = dev->data;
+#endif
+
+    switch (action) {
+    case PM_DEVICE_ACTION_SUSPEND:
+#if CONFIG_PM_DEVICE_RUNTIME
+        /**
+         * The reference of the last blast is put after 'sem' is given, so the next blast may
+         * already hold 'sem'. It takes its own reference before it touches the PWM.
+         */
+        if (!nrfx_pwm_is_stopped(&m_avail_pwms[p_cfg->pwm_index].pwm_instance)) {
+#else
+        if (0 == k_sem_count_get(&p_data->sem)) {
+#endif
+            /* A blast is still playing. */
+            return -EBUSY;
+        }
+        /**
+         * A stopped PWM doesn't request the high frequency clock by itself but an initialized
+         * one keeps its registers and pin. Uninitializing it releases both, and the pin is
+         * driven low by the GPIO so the LED stays off.
+         */
+        nrfx_pwm_uninit(&m_avail_pwms[p_cfg->pwm_index].pwm_instance);
+        m_avail_pwms[p_cfg->pwm_index].ready = false;
+        nrf_gpio_pin_clear(p_cfg->pin);
+        nrf_gpio_cfg_output(p_cfg->pin);
+        return 0;
+
+    case PM_DEVICE_ACTION_RESUME:
+        return pwm_setup(dev);
+
+    default:
+        return -ENOTSUP;
+    }
+}
+#endif /* CONFIG_PM_DEVICE */
+
 static const struct rad_tx_driver_api rad_tx_driver_api = {
     .init          = dmv_rad_tx_init,
     .blast_again   = dmv_rad_tx_blast_again,
+#if CONFIG_RAD_TX_STATS
+    .stats_get     = dmv_rad_tx_stats_get,
+#endif
+#if CONFIG_RAD_TX_ASYNC
+    .blast_async   = dmv_rad_tx_blast_async,
+    .set_callback  = dmv_rad_tx_set_callback,
+#endif
+#if CONFIG_RAD_TX_SLOTS
+    .slot_set      = dmv_rad_tx_slot_set,
+    .slot_blast    = dmv_rad_tx_slot_blast,
+#endif
 #if CONFIG_RAD_TX_RAD
     .rad_blast     = dmv_rad_tx_rad_blast,
 #endif
-#if CONFIG_RAD_TX_RAD
+#if CONFIG_RAD_TX_LASER_X
     .laser_x_blast = dmv_rad_tx_laser_x_blast,
 #endif
 #if CONFIG_RAD_TX_DYNASTY
@@ -296,10 +1070,11 @@ static const struct rad_tx_driver_api rad_tx_driver_api = {
         .pwm_index = (n) \
     }; \
     static struct rad_tx_data rad_tx_data_##n; \
+    PM_DEVICE_DEFINE(rad_tx_##n, dmv_rad_tx_pm_action); \
     DEVICE_DEFINE(rad_tx_##n, \
                 DT_LABEL(INST(n)), \
                 dmv_rad_tx_init, \
-                NULL, \
+                PM_DEVICE_GET(rad_tx_##n), \
                 &rad_tx_data_##n, \
                 &rad_tx_cfg_##n, \
                 POST_KERNEL, \
@@ -20,31 +20,25 @@ extern "C" {
 #include <device.h>
 
 #include <rad.h>
+#include <rad_protocol.h>
 
 #define RAD_RX_START_PULSE_MARGIN_US 500 /* A valid start pulse can be +/- this much. */
+#if CONFIG_RAD_RX_CAPTURE_TIMER
+/* Edges are timestamped by hardware so only the sensor's own distortion has to be covered. */
+#define RAD_RX_BIT_MARGIN_US         100 /* A valid bit pulse can be +/- this much. */
+#else
 #define RAD_RX_BIT_MARGIN_US         125 /* A valid bit pulse can be +/- this much. */
+#endif
 
 #define RAD_RX_MSG_MAX_LEN           0
 #define RAD_RX_LINE_CLEAR_LEN_US     0
 
-typedef enum
-{
-    RAD_PARSE_STATE_WAIT_FOR_START_PULSE, /* A valid start pulse is required before parsing. */
-    RAD_PARSE_STATE_INCOMPLETE,           /* Not enough of the message has been received. */
-    RAD_PARSE_STATE_INVALID,              /* The message is not going to work out. */
-    RAD_PARSE_STATE_VALID,                /* The message is valid. */
-    RAD_PARSE_STATE_COUNT
-} rad_parse_state_t;
-
 #if CONFIG_RAD_MSG_TYPE_RAD
 #if RAD_RX_MSG_MAX_LEN < RAD_MSG_TYPE_RAD_LEN_PULSES
 #undef RAD_RX_MSG_MAX_LEN
 #define RAD_RX_MSG_MAX_LEN RAD_MSG_TYPE_RAD_LEN_PULSES
 #endif
 #if CONFIG_RAD_RX_ACCEPT_RAD
-rad_parse_state_t rad_msg_type_rad_parse(uint32_t *message,
-                                           uint32_t len,
-                                           rad_msg_rad_t *msg);
 #if RAD_RX_LINE_CLEAR_LEN_US < RAD_MSG_TYPE_RAD_LINE_CLEAR_LEN_US
 #undef RAD_RX_LINE_CLEAR_LEN_US
 #define RAD_RX_LINE_CLEAR_LEN_US RAD_MSG_TYPE_RAD_LINE_CLEAR_LEN_US
@@ -59,9 +53,6 @@ rad_parse_state_t rad_msg_type_rad_parse(uint32_t *message,
 #define RAD_RX_MSG_MAX_LEN RAD_MSG_TYPE_DYNASTY_LEN_PULSES
 #endif
 #if CONFIG_RAD_RX_ACCEPT_DYNASTY
-rad_parse_state_t rad_msg_type_dynasty_parse(uint32_t *message,
-                                               uint32_t len,
-                                               rad_msg_dynasty_t *msg);
 #if RAD_RX_LINE_CLEAR_LEN_US < RAD_MSG_TYPE_DYNASTY_LINE_CLEAR_LEN_US
 #undef RAD_RX_LINE_CLEAR_LEN_US
 #define RAD_RX_LINE_CLEAR_LEN_US RAD_MSG_TYPE_DYNASTY_LINE_CLEAR_LEN_US
@@ -72,12 +63,9 @@ rad_parse_state_t rad_msg_type_dynasty_parse(uint32_t *message,
 #if CONFIG_RAD_MSG_TYPE_LASER_X
 #if RAD_RX_MSG_MAX_LEN < RAD_MSG_TYPE_LASER_X_LEN_PULSES
 #undef RAD_RX_MSG_MAX_LEN
-#define RAD_RX_MAX_LEN RAD_MSG_TYPE_LASER_X_LEN_PULSES
+#define RAD_RX_MSG_MAX_LEN RAD_MSG_TYPE_LASER_X_LEN_PULSES
 #endif
 #if CONFIG_RAD_RX_ACCEPT_LASER_X
-rad_parse_state_t rad_msg_type_laser_x_parse(uint32_t *message,
-                                               uint32_t len,
-                                               rad_msg_laser_x_t *msg);
 #if RAD_RX_LINE_CLEAR_LEN_US < RAD_MSG_TYPE_LASER_X_LINE_CLEAR_LEN_US
 #undef RAD_RX_LINE_CLEAR_LEN_US
 #define RAD_RX_LINE_CLEAR_LEN_US RAD_MSG_TYPE_LASER_X_LINE_CLEAR_LEN_US
@@ -85,24 +73,141 @@ rad_parse_state_t rad_msg_type_laser_x_parse(uint32_t *message,
 #endif /* CONFIG_RAD_RX_ACCEPT_LASER_X */
 #endif /* CONFIG_RAD_MSG_TYPE_LASER_X */
 
+#if CONFIG_RAD_MSG_TYPE_LEARNED
+#if RAD_RX_MSG_MAX_LEN < RAD_MSG_TYPE_LEARNED_LEN_PULSES
+#undef RAD_RX_MSG_MAX_LEN
+#define RAD_RX_MSG_MAX_LEN RAD_MSG_TYPE_LEARNED_LEN_PULSES
+#endif
+#if CONFIG_RAD_RX_ACCEPT_LEARNED
+#if RAD_RX_LINE_CLEAR_LEN_US < RAD_MSG_TYPE_LEARNED_LINE_CLEAR_LEN_US
+#undef RAD_RX_LINE_CLEAR_LEN_US
+#define RAD_RX_LINE_CLEAR_LEN_US RAD_MSG_TYPE_LEARNED_LINE_CLEAR_LEN_US
+#endif
+#endif /* CONFIG_RAD_RX_ACCEPT_LEARNED */
+#endif /* CONFIG_RAD_MSG_TYPE_LEARNED */
+
 #if CONFIG_RAD_RX
 #if RAD_RX_LINE_CLEAR_LEN_US == 0
 #error No Rad RX message types enabled
 #endif
 #endif
 
-/* This callback is called from the driver to notify the app that a message was received. */
+/**
+ * This callback is called from the driver to notify the app that a message was received. It runs
+ * on the decoding workqueue (the System Workqueue unless CONFIG_RAD_RX_WORKQUEUE is enabled) or,
+ * with CONFIG_RAD_RX_CALLBACK_THREAD, on the driver's callback thread. 'data' is only valid
+ * until the callback returns.
+ */
 typedef void (*rad_rx_callback_t) (rad_msg_type_t msg_type, void *data);
 
-typedef int (*rad_rx_init_t)         (const struct device *dev);
-typedef int (*rad_rx_set_callback_t) (const struct device *dev, rad_rx_callback_t cb);
+enum rad_rx_event_type {
+    RAD_RX_EVENT_MSG,       /* A message was received. */
+    RAD_RX_EVENT_COLLISION, /* Frames from several transmitters overlapped. */
+};
+
+/**
+ * How a frame was recognized as a collision (see CONFIG_RAD_RX_COLLISION_DETECT).
+ */
+enum rad_rx_collision {
+    RAD_RX_COLLISION_LENGTH, /* The frame went on after a complete message. */
+    RAD_RX_COLLISION_WIDTH,  /* A pulse that none of the possible message types use. */
+    RAD_RX_COLLISION_START,  /* A start pulse in the middle of the frame. */
+    RAD_RX_COLLISION_COUNT
+};
+
+/**
+ * A received message or collision as queued by CONFIG_RAD_RX_EVENT_QUEUE.
+ */
+struct rad_rx_event {
+    enum rad_rx_event_type type;
+    rad_msg_type_t         msg_type;   /* RAD_RX_EVENT_MSG only. */
+    union {
+        rad_msg_t             msg;       /* RAD_RX_EVENT_MSG */
+        enum rad_rx_collision collision; /* RAD_RX_EVENT_COLLISION */
+    };
+    uint32_t               timestamp;  /* Start of the frame in RAD_RX_TICKS_PER_SEC ticks. */
+    uint8_t                sensor_id;  /* 'sensor-id' property of the receiver. */
+    uint8_t                confidence; /* 0-100, see CONFIG_RAD_RX_SOFT_DECISION. */
+    uint8_t                repaired;   /* Number of bits corrected, see CONFIG_RAD_RX_REPAIR. */
+    uint8_t                repeats;    /* Copies of the message, see CONFIG_RAD_RX_REPEAT_SUPPRESS. */
+};
+
+/**
+ * Counters kept by a receiver with CONFIG_RAD_RX_STATS. They only ever increase and wrap at
+ * 2^32. Message types are indexed by rad_msg_type_t and reasons by rad_parse_reject_t.
+ */
+struct rad_rx_stats {
+    uint32_t edges;               /* Edges reported by the capture backend. */
+    uint32_t glitches;            /* Marks discarded by CONFIG_RAD_RX_GLITCH_FILTER_US. */
+    uint32_t frames;              /* Edges that started a frame after the line was clear. */
+    uint32_t overflows;           /* Times the edge ring was full. */
+    uint32_t line_clear_timeouts; /* Frames that ended while a message was incomplete. */
+    uint32_t dropped;             /* Events that didn't fit in the event queue. */
+    uint32_t repeats;             /* Copies merged by CONFIG_RAD_RX_REPEAT_SUPPRESS. */
+    uint32_t accepted[RAD_MSG_TYPE_COUNT];
+    uint32_t rejected[RAD_MSG_TYPE_COUNT][RAD_PARSE_REJECT_COUNT];
+};
+
+#if CONFIG_RAD_RX_RECORD
+#define RAD_RX_RECORD_FLAG_DECODED   BIT(0) /* A message was decoded from the train. */
+#define RAD_RX_RECORD_FLAG_TRUNCATED BIT(1) /* More than CONFIG_RAD_RX_RECORD_MAX_PULSES. */
+#define RAD_RX_RECORD_FLAG_OVERFLOW  BIT(2) /* The edge ring overflowed during the train. */
+
+/**
+ * A pulse train as queued by CONFIG_RAD_RX_RECORD. A train starts with the first active edge
+ * after the line was clear and ends when the line is clear again, whether or not it was decoded.
+ * The pulses alternate between active and inactive starting with an active one, just like the
+ * pulses of rad_rx_sim_feed, and are saturated at UINT16_MAX.
+ */
+struct rad_rx_record {
+    uint32_t timestamp;  /* Start of the train in RAD_RX_TICKS_PER_SEC ticks. */
+    uint16_t len;        /* Pulses in 'pulses_us'. */
+    uint8_t  sensor_id;  /* 'sensor-id' property of the receiver. */
+    uint8_t  flags;      /* RAD_RX_RECORD_FLAG_* */
+    uint16_t pulses_us[CONFIG_RAD_RX_RECORD_MAX_PULSES];
+};
+#endif /* CONFIG_RAD_RX_RECORD */
+
+typedef int (*rad_rx_init_t)           (const struct device *dev);
+typedef int (*rad_rx_set_callback_t)   (const struct device *dev, rad_rx_callback_t cb);
+typedef int (*rad_rx_read_t)           (const struct device *dev,
+                                        struct rad_rx_event *events,
+                                        size_t max,
+                                        k_timeout_t timeout);
+typedef int (*rad_rx_poll_init_t)      (const struct device *dev, struct k_poll_event *event);
+typedef int (*rad_rx_collisions_get_t) (const struct device *dev, uint32_t *counts);
+typedef int (*rad_rx_stats_get_t)      (const struct device *dev, struct rad_rx_stats *stats);
+#if CONFIG_RAD_RX_RECORD
+typedef int (*rad_rx_record_read_t)    (const struct device *dev,
+                                        struct rad_rx_record *record,
+                                        k_timeout_t timeout);
+typedef int (*rad_rx_replay_t)         (const struct device *dev,
+                                        const uint16_t *pulses_us,
+                                        size_t len);
+#endif
+#if CONFIG_RAD_RX_REPEAT_SUPPRESS
+typedef int (*rad_rx_repeat_window_set_t) (const struct device *dev,
+                                           rad_msg_type_t msg_type,
+                                           uint16_t window_ms);
+#endif
 
 /**
  * @brief Rad receiver driver API
  */
 struct rad_rx_driver_api {
-    rad_rx_init_t         init;
-    rad_rx_set_callback_t set_callback;
+    rad_rx_init_t           init;
+    rad_rx_set_callback_t   set_callback;
+    rad_rx_read_t           read;
+    rad_rx_poll_init_t      poll_init;
+    rad_rx_collisions_get_t collisions_get;
+    rad_rx_stats_get_t      stats_get;
+#if CONFIG_RAD_RX_RECORD
+    rad_rx_record_read_t    record_read;
+    rad_rx_replay_t         replay;
+#endif
+#if CONFIG_RAD_RX_REPEAT_SUPPRESS
+    rad_rx_repeat_window_set_t repeat_window_set;
+#endif
 };
 
 static inline int rad_rx_init(const struct device *dev)
@@ -137,11 +242,270 @@ static inline int rad_rx_set_callback(const struct device *dev, rad_rx_callback_
     return api->set_callback(dev, cb);
 }
 
-#define IS_VALID_START_PULSE(value, target) ((target)-RAD_RX_START_PULSE_MARGIN_US <= (value) && \
-                                                (target)+RAD_RX_START_PULSE_MARGIN_US >= (value))
+/**
+ * @brief Read up to 'max' queued events.
+ *
+ * Waits up to 'timeout' for the first event, then takes the events that are already queued
+ * without waiting. Requires CONFIG_RAD_RX_EVENT_QUEUE. Events are queued whether or not a
+ * callback is set.
+ *
+ * @return Number of events read (0 on timeout) or a negative error code.
+ */
+static inline int rad_rx_read_batch(const struct device *dev,
+                                    struct rad_rx_event *events,
+                                    size_t max,
+                                    k_timeout_t timeout)
+{
+    struct rad_rx_driver_api *api;
+
+    if ((dev == NULL) || (events == NULL)) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_rx_driver_api*)dev->api;
+
+    if (api->read == NULL) {
+        return -ENOTSUP;
+    }
+    return api->read(dev, events, max, timeout);
+}
+
+/**
+ * @brief Read the next queued event.
+ *
+ * @return 0 on success, -EAGAIN if no event was received within 'timeout'.
+ */
+static inline int rad_rx_read(const struct device *dev,
+                              struct rad_rx_event *event,
+                              k_timeout_t timeout)
+{
+    int ret = rad_rx_read_batch(dev, event, 1, timeout);
+
+    if (ret < 0) {
+        return ret;
+    }
+    return (ret ? 0 : -EAGAIN);
+}
+
+/**
+ * @brief Initialize a k_poll event that is signaled while events are queued.
+ *
+ * Requires CONFIG_RAD_RX_EVENT_QUEUE and CONFIG_POLL. Once k_poll returns, read the events
+ * with rad_rx_read_batch and K_NO_WAIT, then reset the state of the poll event.
+ */
+static inline int rad_rx_poll_event_init(const struct device *dev, struct k_poll_event *event)
+{
+    struct rad_rx_driver_api *api;
+
+    if ((dev == NULL) || (event == NULL)) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_rx_driver_api*)dev->api;
+
+    if (api->poll_init == NULL) {
+        return -ENOTSUP;
+    }
+    return api->poll_init(dev, event);
+}
+
+/**
+ * @brief Get the number of collisions detected so far.
+ *
+ * Requires CONFIG_RAD_RX_COLLISION_DETECT.
+ *
+ * @param counts Written with RAD_RX_COLLISION_COUNT counters, indexed by enum rad_rx_collision.
+ */
+static inline int rad_rx_collisions_get(const struct device *dev, uint32_t *counts)
+{
+    struct rad_rx_driver_api *api;
+
+    if ((dev == NULL) || (counts == NULL)) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_rx_driver_api*)dev->api;
+
+    if (api->collisions_get == NULL) {
+        return -ENOTSUP;
+    }
+    return api->collisions_get(dev, counts);
+}
+
+/**
+ * @brief Get a snapshot of the receiver's counters.
+ *
+ * Requires CONFIG_RAD_RX_STATS. The ISR and the decoder keep counting while the snapshot is
+ * taken so counters may be slightly out of step with each other.
+ */
+static inline int rad_rx_stats_get(const struct device *dev, struct rad_rx_stats *stats)
+{
+    struct rad_rx_driver_api *api;
+
+    if ((dev == NULL) || (stats == NULL)) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_rx_driver_api*)dev->api;
+
+    if (api->stats_get == NULL) {
+        return -ENOTSUP;
+    }
+    return api->stats_get(dev, stats);
+}
+
+#if CONFIG_RAD_RX_RECORD
+/**
+ * @brief Read the oldest recorded pulse train.
+ *
+ * Requires CONFIG_RAD_RX_RECORD. Trains are queued until they're read. Once
+ * CONFIG_RAD_RX_RECORD_QUEUE_SIZE trains are waiting, newer ones are dropped so the trains
+ * that are read never have gaps between them.
+ *
+ * @return 0 on success, -EAGAIN if no train was recorded within 'timeout'.
+ */
+static inline int rad_rx_record_read(const struct device *dev,
+                                     struct rad_rx_record *record,
+                                     k_timeout_t timeout)
+{
+    struct rad_rx_driver_api *api;
+
+    if ((dev == NULL) || (record == NULL)) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_rx_driver_api*)dev->api;
+
+    if (api->record_read == NULL) {
+        return -ENOTSUP;
+    }
+    return api->record_read(dev, record, timeout);
+}
+
+/**
+ * @brief Decode a pulse train as if the receiver had just seen it.
+ *
+ * Requires CONFIG_RAD_RX_RECORD. The pulses take the same path through the decoder as real
+ * ones, including the callback, the event queue and recording, so a recorded train can be
+ * replayed to reproduce how it was decoded. Real pulses that arrive before the line is clear
+ * again are discarded.
+ *
+ * @param pulses_us Pulse lengths in microseconds, starting with an active pulse.
+ *
+ * @return 0 on success, -EINVAL if the train is empty or longer than the edge ring can ever
+ *         hold (CONFIG_RAD_RX_EDGE_RING_SIZE - 2 pulses), -EBUSY if the line is active or the
+ *         edge ring doesn't have room right now, in which case the replay can be retried.
+ */
+static inline int rad_rx_replay(const struct device *dev, const uint16_t *pulses_us, size_t len)
+{
+    struct rad_rx_driver_api *api;
+
+    if ((dev == NULL) || (pulses_us == NULL) || (len == 0)) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_rx_driver_api*)dev->api;
+
+    if (api->replay == NULL) {
+        return -ENOTSUP;
+    }
+    return api->replay(dev, pulses_us, len);
+}
+#endif /* CONFIG_RAD_RX_RECORD */
+
+#if CONFIG_RAD_RX_REPEAT_SUPPRESS
+/**
+ * @brief Set how long a receiver waits for more copies of a message of a particular type.
+ *
+ * Requires CONFIG_RAD_RX_REPEAT_SUPPRESS. A message whose frame starts within 'window_ms' of
+ * the previous copy of the same message is merged into it. The callback, the event queue and
+ * the group only see the message once no copy has arrived for 'window_ms', and the event
+ * counts the copies in 'repeats'. Every message type starts with CONFIG_RAD_RX_REPEAT_WINDOW_MS.
+ *
+ * @param window_ms 0 to deliver every copy right away.
+ */
+static inline int rad_rx_repeat_window_set(const struct device *dev,
+                                           rad_msg_type_t msg_type,
+                                           uint16_t window_ms)
+{
+    struct rad_rx_driver_api *api;
+
+    if ((dev == NULL) || (msg_type >= RAD_MSG_TYPE_COUNT)) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_rx_driver_api*)dev->api;
+
+    if (api->repeat_window_set == NULL) {
+        return -ENOTSUP;
+    }
+    return api->repeat_window_set(dev, msg_type, window_ms);
+}
+#endif /* CONFIG_RAD_RX_REPEAT_SUPPRESS */
 
-#define IS_VALID_BIT_PULSE(value, target) ((target)-RAD_RX_BIT_MARGIN_US <= (value) && \
-                                                (target)+RAD_RX_BIT_MARGIN_US >= (value))
+#if CONFIG_RAD_RX_CAPTURE_SIM
+/**
+ * @brief Feed simulated pulses to a receiver.
+ *
+ * The pulses alternate between active and inactive, starting with an active pulse (e.g. the
+ * start pulse of a frame). An inactive edge is generated after the last pulse if it is active.
+ * Decoding runs exactly as it does for real edges.
+ *
+ * @param dev       The receiver (CONFIG_RAD_RX_CAPTURE_SIM must be selected).
+ * @param idle_us   Time since the end of the previous pulse, e.g. the gap between frames.
+ * @param pulses_us Pulse lengths in microseconds.
+ * @param len       Number of pulses.
+ */
+int rad_rx_sim_feed(const struct device *dev,
+                    uint32_t idle_us,
+                    const uint32_t *pulses_us,
+                    size_t len);
+
+/**
+ * @brief Toggle the level of a simulated receiver.
+ *
+ * Unlike rad_rx_sim_feed, the line is left where it is, so tests can hold it active while
+ * real time passes, e.g. across the decoder's line clear deadline in the middle of a mark.
+ *
+ * @param dev      The receiver (CONFIG_RAD_RX_CAPTURE_SIM must be selected).
+ * @param after_us Time since the previous edge or the end of the previous pulse.
+ */
+int rad_rx_sim_edge(const struct device *dev, uint32_t after_us);
+#endif /* CONFIG_RAD_RX_CAPTURE_SIM */
+
+/**
+ * Edges are timestamped in capture ticks and pulses are never converted to microseconds.
+ * Instead, every pulse length that the receiver checks against is converted to a window of
+ * ticks at build time. Windows are rounded outwards so they're never narrower than the margin.
+ */
+#if CONFIG_RAD_RX_CAPTURE_GPIO
+#define RAD_RX_TICKS_PER_SEC CONFIG_SYS_CLOCK_HW_CYCLES_PER_SEC /* k_cycle_get_32 */
+#else
+#define RAD_RX_TICKS_PER_SEC USEC_PER_SEC /* 1 MHz TIMER or simulated microseconds. */
+#endif
+
+#define RAD_RX_US_TO_TICKS_FLOOR(us) \
+    ((uint32_t)(((uint64_t)(us) * RAD_RX_TICKS_PER_SEC) / USEC_PER_SEC))
+#define RAD_RX_US_TO_TICKS_CEIL(us) \
+    ((uint32_t)((((uint64_t)(us) * RAD_RX_TICKS_PER_SEC) + USEC_PER_SEC - 1) / USEC_PER_SEC))
+#define RAD_RX_TICKS_TO_US(ticks) \
+    ((uint32_t)(((uint64_t)(ticks) * USEC_PER_SEC) / RAD_RX_TICKS_PER_SEC))
+
+#define RAD_RX_WINDOW(target_us, margin_us) { \
+        .min = RAD_RX_US_TO_TICKS_FLOOR((target_us) - (margin_us)), \
+        .max = RAD_RX_US_TO_TICKS_CEIL((target_us) + (margin_us)), \
+    }
+
+#define RAD_RX_START_WINDOW(target_us) RAD_RX_WINDOW(target_us, RAD_RX_START_PULSE_MARGIN_US)
+#define RAD_RX_BIT_WINDOW(target_us)   RAD_RX_WINDOW(target_us, RAD_RX_BIT_MARGIN_US)
+
+#define RAD_RX_IN_WINDOW(ticks, window) (((window).min <= (ticks)) && ((window).max >= (ticks)))
+
+#define RAD_RX_LINE_CLEAR_LEN_TICKS RAD_RX_US_TO_TICKS_FLOOR(RAD_RX_LINE_CLEAR_LEN_US)
+
+#if CONFIG_RAD_RX_GLITCH_FILTER_US
+#define RAD_RX_GLITCH_LEN_TICKS     RAD_RX_US_TO_TICKS_CEIL(CONFIG_RAD_RX_GLITCH_FILTER_US)
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,67 @@
+/**
+ * @file rad_rx_group.h
+ *
+ * @brief Public API for groups of Rad receivers
+ */
+
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#ifndef ZEPHYR_INCLUDE_RAD_RX_GROUP_H_
+#define ZEPHYR_INCLUDE_RAD_RX_GROUP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr.h>
+#include <device.h>
+
+#include <drivers/rad_rx.h>
+
+/**
+ * A group ("dmv,rad-rx-group") combines several receivers that are worn by the same player,
+ * e.g. the sensors of a vest. One shot usually hits more than one of them so identical
+ * messages that arrive within the group's window are merged into a single callback.
+ */
+
+/**
+ * This callback is called from the driver to notify the app that a message was received by
+ * at least one receiver of the group. Bit n of 'sensors' is set if the n-th receiver listed in
+ * the group's 'sensors' property received the message. It runs in the same context as
+ * rad_rx_callback_t and 'data' is only valid until the callback returns.
+ */
+typedef void (*rad_rx_group_callback_t) (rad_msg_type_t msg_type, void *data, uint32_t sensors);
+
+typedef int (*rad_rx_group_set_callback_t) (const struct device *dev, rad_rx_group_callback_t cb);
+
+/**
+ * @brief Rad receiver group driver API
+ */
+struct rad_rx_group_driver_api {
+    rad_rx_group_set_callback_t set_callback;
+};
+
+static inline int rad_rx_group_set_callback(const struct device *dev, rad_rx_group_callback_t cb)
+{
+    struct rad_rx_group_driver_api *api;
+
+    if (dev == NULL) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_rx_group_driver_api*)dev->api;
+
+    if (api->set_callback == NULL) {
+        return -ENOTSUP;
+    }
+    return api->set_callback(dev, cb);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_RAD_RX_GROUP_H_ */
@@ -21,6 +21,7 @@ extern "C" {
 #include <stdbool.h>
 
 #include <rad.h>
+#include <rad_protocol.h>
 #include <nrfx_pwm.h>
 
 /**
@@ -31,94 +32,91 @@ extern "C" {
 #define RAD_TX_DUTY_CYCLE_50                      (RAD_TX_TICKS_PER_PERIOD / 2)
 #define RAD_TX_PWM_VALUE_LEN_US                   26
 
-#define RAD_TX_RAD_START_PULSE_LEN_PWM_VALUES     (RAD_MSG_TYPE_RAD_START_PULSE_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_RAD_ACTIVE_PULSE_LEN_PWM_VALUES    (RAD_MSG_TYPE_RAD_ACTIVE_PULSE_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_RAD_0_PULSE_LEN_PWM_VALUES         (RAD_MSG_TYPE_RAD_0_PULSE_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_RAD_1_PULSE_LEN_PWM_VALUES         (RAD_MSG_TYPE_RAD_1_PULSE_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_RAD_0_BIT_LEN_PWM_VALUES           (RAD_MSG_TYPE_RAD_0_BIT_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_RAD_1_BIT_LEN_PWM_VALUES           (RAD_MSG_TYPE_RAD_1_BIT_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_RAD_MAX_BIT_LEN_PWM_VALUES         MAX(RAD_TX_RAD_0_BIT_LEN_PWM_VALUES, \
-                                                    RAD_TX_RAD_1_BIT_LEN_PWM_VALUES)
-#define RAD_TX_RAD_MAX_MSG_LEN_PWM_VALUES         (RAD_TX_RAD_START_PULSE_LEN_PWM_VALUES + \
-                                                    (RAD_TX_RAD_MAX_BIT_LEN_PWM_VALUES * \
-                                                    RAD_MSG_TYPE_RAD_LEN_IR_BITS) + 1)
-
-#define RAD_TX_DYNASTY_START_PULSE_LEN_PWM_VALUES (RAD_MSG_TYPE_DYNASTY_START_PULSE_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_DYNASTY_0_PULSE_LEN_PWM_VALUES     (RAD_MSG_TYPE_DYNASTY_0_PULSE_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_DYNASTY_1_PULSE_LEN_PWM_VALUES     (RAD_MSG_TYPE_DYNASTY_1_PULSE_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_DYNASTY_MAX_BIT_LEN_PWM_VALUES     MAX(RAD_TX_DYNASTY_0_PULSE_LEN_PWM_VALUES, \
-                                                    RAD_TX_DYNASTY_1_PULSE_LEN_PWM_VALUES)
-#define RAD_TX_DYNASTY_MAX_MSG_LEN_PWM_VALUES     (RAD_TX_DYNASTY_START_PULSE_LEN_PWM_VALUES + \
-                                                    (RAD_TX_DYNASTY_MAX_BIT_LEN_PWM_VALUES * \
-                                                    RAD_MSG_TYPE_DYNASTY_LEN_IR_BITS) + 1)
-
-#define RAD_TX_LASER_X_START_PULSE_LEN_PWM_VALUES (RAD_MSG_TYPE_LASER_X_START_PULSE_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_LASER_X_SPACE_PULSE_PWM_VALUES     (RAD_MSG_TYPE_LASER_X_SPACE_PULSE_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_LASER_X_0_PULSE_LEN_PWM_VALUES     (RAD_MSG_TYPE_LASER_X_0_PULSE_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_LASER_X_1_PULSE_LEN_PWM_VALUES     (RAD_MSG_TYPE_LASER_X_1_PULSE_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_LASER_X_0_BIT_LEN_PWM_VALUES       (RAD_MSG_TYPE_LASER_X_0_BIT_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_LASER_X_1_BIT_LEN_PWM_VALUES       (RAD_MSG_TYPE_LASER_X_1_BIT_LEN_US / \
-                                                    RAD_TX_PWM_VALUE_LEN_US)
-#define RAD_TX_LASER_X_MAX_BIT_LEN_PWM_VALUES     MAX(RAD_TX_LASER_X_0_BIT_LEN_PWM_VALUES, \
-                                                    RAD_TX_LASER_X_1_BIT_LEN_PWM_VALUES)
-#define RAD_TX_LASER_X_MAX_MSG_LEN_PWM_VALUES     (RAD_TX_LASER_X_START_PULSE_LEN_PWM_VALUES + \
-                                                    (RAD_TX_LASER_X_MAX_BIT_LEN_PWM_VALUES * \
-                                                    RAD_MSG_TYPE_LASER_X_LEN_IR_BITS) + 1)
-
-#define RAD_TX_MSG_MAX_LEN_PWM_VALUES 0
+/**
+ * Frames are encoded as runs (see rad_run_t): the start pulse, one run per pulse of each bit
+ * and the inactive value that ends the frame. Only the runs are kept so the RAM taken by a
+ * frame doesn't depend on how long it lasts.
+ */
+#define RAD_TX_RAD_MAX_MSG_RUNS     (1 + (2 * RAD_MSG_TYPE_RAD_LEN_IR_BITS) + 1)
+#define RAD_TX_DYNASTY_MAX_MSG_RUNS (1 + RAD_MSG_TYPE_DYNASTY_LEN_IR_BITS + 1)
+#define RAD_TX_LASER_X_MAX_MSG_RUNS (1 + (2 * RAD_MSG_TYPE_LASER_X_LEN_IR_BITS) + 1)
+
+#define RAD_TX_MSG_MAX_RUNS 0
 
 #if CONFIG_RAD_TX_RAD
-int rad_msg_type_rad_encode(const rad_msg_rad_t *msg,
-                              nrf_pwm_values_common_t *values,
-                              uint32_t *len);
-#if RAD_TX_MSG_MAX_LEN_PWM_VALUES < RAD_TX_RAD_MAX_MSG_LEN_PWM_VALUES
-#undef RAD_TX_MSG_MAX_LEN_PWM_VALUES
-#define RAD_TX_MSG_MAX_LEN_PWM_VALUES RAD_TX_RAD_MAX_MSG_LEN_PWM_VALUES
+#if RAD_TX_MSG_MAX_RUNS < RAD_TX_RAD_MAX_MSG_RUNS
+#undef RAD_TX_MSG_MAX_RUNS
+#define RAD_TX_MSG_MAX_RUNS RAD_TX_RAD_MAX_MSG_RUNS
 #endif
 #endif /* CONFIG_RAD_TX_RAD */
 
 #if CONFIG_RAD_TX_DYNASTY
-int rad_msg_type_dynasty_encode(const rad_msg_dynasty_t *msg,
-                                  nrf_pwm_values_common_t *values,
-                                  uint32_t *len);
-#if RAD_TX_MSG_MAX_LEN_PWM_VALUES < RAD_TX_DYNASTY_MAX_MSG_LEN_PWM_VALUES
-#undef RAD_TX_MSG_MAX_LEN_PWM_VALUES
-#define RAD_TX_MSG_MAX_LEN_PWM_VALUES RAD_TX_DYNASTY_MAX_MSG_LEN_PWM_VALUES
+#if RAD_TX_MSG_MAX_RUNS < RAD_TX_DYNASTY_MAX_MSG_RUNS
+#undef RAD_TX_MSG_MAX_RUNS
+#define RAD_TX_MSG_MAX_RUNS RAD_TX_DYNASTY_MAX_MSG_RUNS
 #endif
 #endif /* CONFIG_RAD_TX_DYNASTY */
 
 #if CONFIG_RAD_TX_LASER_X
-int rad_msg_type_laser_x_encode(const rad_msg_laser_x_t *msg,
-                                  nrf_pwm_values_common_t *values,
-                                  uint32_t *len);
-#if RAD_TX_MSG_MAX_LEN_PWM_VALUES < RAD_TX_LASER_X_MAX_MSG_LEN_PWM_VALUES
-#undef RAD_TX_MSG_MAX_LEN_PWM_VALUES
-#define RAD_TX_MSG_MAX_LEN_PWM_VALUES RAD_TX_LASER_X_MAX_MSG_LEN_PWM_VALUES
+#if RAD_TX_MSG_MAX_RUNS < RAD_TX_LASER_X_MAX_MSG_RUNS
+#undef RAD_TX_MSG_MAX_RUNS
+#define RAD_TX_MSG_MAX_RUNS RAD_TX_LASER_X_MAX_MSG_RUNS
 #endif
 #endif /* CONFIG_RAD_TX_LASER_X */
 
 #if CONFIG_RAD_TX
-#if RAD_TX_MSG_MAX_LEN_PWM_VALUES == 0
+#if RAD_TX_MSG_MAX_RUNS == 0
 #error No Rad TX message types enabled
 #endif
 #endif
 
+/**
+ * Counters kept by a transmitter with CONFIG_RAD_TX_STATS. They only ever increase and wrap at
+ * 2^32.
+ */
+struct rad_tx_stats {
+    uint32_t blasts;     /* Blasts started, including repeats. */
+    uint32_t values;     /* PWM values played. */
+    uint32_t busy_waits; /* Blasts that had to wait for the previous blast to finish. */
+    uint32_t wait_us;    /* Total time spent waiting for the previous blast to finish. */
+    uint32_t airtime_us; /* Total time spent transmitting. */
+    uint32_t preemptions; /* Queued blasts cut short by a more urgent one. */
+};
+
+#if CONFIG_RAD_TX_ASYNC
+/* Flags of rad_tx_blast_priority. */
+#define RAD_TX_FLAG_REQUEUE BIT(0) /* Queue again if preempted instead of dropping. */
+
+/**
+ * This callback is called from the PWM interrupt when a blast that was queued with
+ * rad_tx_blast_async has ended. 'result' is 0 if the blast was sent, -ECANCELED if it was
+ * preempted and not queued again, and another negative error code if it was dropped, e.g.
+ * because the transmitter was suspended.
+ */
+typedef void (*rad_tx_callback_t) (const struct device *dev, rad_msg_type_t msg_type, int result);
+#endif
+
 typedef int (*rad_tx_init_t)        (const struct device *dev);
 typedef int (*rad_tx_blast_again_t) (const struct device *dev); /* Repeat the last blast. */
+typedef int (*rad_tx_stats_get_t)   (const struct device *dev, struct rad_tx_stats *stats);
+
+#if CONFIG_RAD_TX_ASYNC
+typedef int (*rad_tx_blast_async_t)  (const struct device *dev,
+                                      rad_msg_type_t msg_type,
+                                      const rad_msg_t *msg,
+                                      uint8_t priority,
+                                      uint8_t flags,
+                                      struct k_poll_signal *signal);
+typedef int (*rad_tx_set_callback_t) (const struct device *dev, rad_tx_callback_t cb);
+#endif
+
+#if CONFIG_RAD_TX_SLOTS
+typedef int (*rad_tx_slot_set_t)   (const struct device *dev,
+                                    uint8_t slot,
+                                    rad_msg_type_t msg_type,
+                                    const rad_msg_t *msg);
+typedef int (*rad_tx_slot_blast_t) (const struct device *dev, uint8_t slot);
+#endif
 
 #if CONFIG_RAD_TX_RAD
 typedef int (*rad_tx_rad_blast_t) (const struct device *dev, const rad_msg_rad_t *msg);
@@ -138,6 +136,15 @@ typedef int (*rad_tx_dynasty_blast_t) (const struct device *dev, const rad_msg_d
 struct rad_tx_driver_api {
     rad_tx_init_t          init;
     rad_tx_blast_again_t   blast_again;
+    rad_tx_stats_get_t     stats_get;
+#if CONFIG_RAD_TX_ASYNC
+    rad_tx_blast_async_t   blast_async;
+    rad_tx_set_callback_t  set_callback;
+#endif
+#if CONFIG_RAD_TX_SLOTS
+    rad_tx_slot_set_t      slot_set;
+    rad_tx_slot_blast_t    slot_blast;
+#endif
 #if CONFIG_RAD_TX_RAD
     rad_tx_rad_blast_t     rad_blast;
 #endif
@@ -181,6 +188,184 @@ static inline int rad_tx_blast_again(const struct device *dev)
     return api->blast_again(dev);
 }
 
+/**
+ * @brief Get a snapshot of the transmitter's counters.
+ *
+ * Requires CONFIG_RAD_TX_STATS.
+ */
+static inline int rad_tx_stats_get(const struct device *dev, struct rad_tx_stats *stats)
+{
+    struct rad_tx_driver_api *api;
+
+    if ((dev == NULL) || (stats == NULL)) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_tx_driver_api*)dev->api;
+
+    if (api->stats_get == NULL) {
+        return -ENOTSUP;
+    }
+    return api->stats_get(dev, stats);
+}
+
+#if CONFIG_RAD_TX_ASYNC
+/**
+ * @brief Queue a blast and return right away.
+ *
+ * Requires CONFIG_RAD_TX_ASYNC. The message is checked and copied into the transmitter's
+ * queue, which holds CONFIG_RAD_TX_ASYNC_QUEUE_SIZE blasts. Queued blasts are started from the
+ * PWM interrupt as soon as the previous blast ends, before any blocking blast, and are followed
+ * by CONFIG_RAD_TX_ASYNC_GAP_US of silence so receivers see them as separate frames.
+ *
+ * Can be called from an ISR that doesn't preempt the PWM interrupt, unless
+ * CONFIG_PM_DEVICE_RUNTIME is enabled.
+ *
+ * @param msg_type Type of the message, which must be enabled with CONFIG_RAD_TX_<TYPE>.
+ * @param msg      The message, as the member of 'msg' that matches 'msg_type'.
+ * @param signal   Raised with the result when the blast ends, or NULL.
+ *
+ * @return 0 if the blast was queued, -EINVAL if the message is invalid, -ENOMEM if the queue
+ *         is full.
+ */
+static inline int rad_tx_blast_async(const struct device *dev,
+                                     rad_msg_type_t msg_type,
+                                     const rad_msg_t *msg,
+                                     struct k_poll_signal *signal)
+{
+    struct rad_tx_driver_api *api;
+
+    if ((dev == NULL) || (msg == NULL)) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_tx_driver_api*)dev->api;
+
+    if (api->blast_async == NULL) {
+        return -ENOTSUP;
+    }
+    return api->blast_async(dev, msg_type, msg, 0, 0, signal);
+}
+
+/**
+ * @brief Queue a blast with a priority and return right away.
+ *
+ * Like rad_tx_blast_async, which queues at priority 0, but queued blasts are started in order
+ * of decreasing priority and only blasts of the same priority are started in the order they
+ * were queued.
+ *
+ * With CONFIG_RAD_TX_PREEMPT, a blast with a higher priority than the queued blast that is
+ * playing also cuts it short. The PWM stops at the end of the current carrier period and this
+ * blast starts after CONFIG_RAD_TX_ASYNC_GAP_US of silence, so receivers drop the partial
+ * frame. The preempted blast is reported with -ECANCELED, or queued again with its priority if
+ * it was queued with RAD_TX_FLAG_REQUEUE. Blocking blasts are never preempted.
+ *
+ * @param priority Higher is more urgent.
+ * @param flags    RAD_TX_FLAG_* or 0.
+ *
+ * @return 0 if the blast was queued, -EINVAL if the message is invalid, -ENOMEM if the queue
+ *         is full.
+ */
+static inline int rad_tx_blast_priority(const struct device *dev,
+                                        rad_msg_type_t msg_type,
+                                        const rad_msg_t *msg,
+                                        uint8_t priority,
+                                        uint8_t flags,
+                                        struct k_poll_signal *signal)
+{
+    struct rad_tx_driver_api *api;
+
+    if ((dev == NULL) || (msg == NULL)) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_tx_driver_api*)dev->api;
+
+    if (api->blast_async == NULL) {
+        return -ENOTSUP;
+    }
+    return api->blast_async(dev, msg_type, msg, priority, flags, signal);
+}
+
+/**
+ * @brief Set the callback that reports the end of every blast queued with rad_tx_blast_async.
+ */
+static inline int rad_tx_set_callback(const struct device *dev, rad_tx_callback_t cb)
+{
+    struct rad_tx_driver_api *api;
+
+    if (dev == NULL) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_tx_driver_api*)dev->api;
+
+    if (api->set_callback == NULL) {
+        return -ENOTSUP;
+    }
+    return api->set_callback(dev, cb);
+}
+#endif /* CONFIG_RAD_TX_ASYNC */
+
+#if CONFIG_RAD_TX_SLOTS
+/**
+ * @brief Encode a message into a slot so it can be blasted later without encoding it again.
+ *
+ * Requires CONFIG_RAD_TX_SLOTS, which sets the number of slots of each transmitter. Slots are
+ * typically filled once, e.g. with the messages of the player's weapon, and fired from the
+ * trigger with rad_tx_slot_blast. Waits for the end of the blast that is playing.
+ *
+ * @param slot     Index of the slot, below CONFIG_RAD_TX_SLOTS.
+ * @param msg_type Type of the message, which must be enabled with CONFIG_RAD_TX_<TYPE>.
+ * @param msg      The message, as the member of 'msg' that matches 'msg_type'.
+ *
+ * @return 0 on success, -EINVAL if the slot or the message is invalid. The slot is empty if
+ *         the message is invalid.
+ */
+static inline int rad_tx_slot_set(const struct device *dev,
+                                  uint8_t slot,
+                                  rad_msg_type_t msg_type,
+                                  const rad_msg_t *msg)
+{
+    struct rad_tx_driver_api *api;
+
+    if ((dev == NULL) || (msg == NULL)) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_tx_driver_api*)dev->api;
+
+    if (api->slot_set == NULL) {
+        return -ENOTSUP;
+    }
+    return api->slot_set(dev, slot, msg_type, msg);
+}
+
+/**
+ * @brief Blast the message that was encoded into a slot.
+ *
+ * Like the rad_tx_<type>_blast functions, but the waveform is played from the slot as it is.
+ * rad_tx_blast_again repeats it until another message is blasted.
+ *
+ * @return 0 on success, -EINVAL if the slot doesn't exist, -ENOENT if it is empty.
+ */
+static inline int rad_tx_slot_blast(const struct device *dev, uint8_t slot)
+{
+    struct rad_tx_driver_api *api;
+
+    if (dev == NULL) {
+        return -EINVAL;
+    }
+
+    api = (struct rad_tx_driver_api*)dev->api;
+
+    if (api->slot_blast == NULL) {
+        return -ENOTSUP;
+    }
+    return api->slot_blast(dev, slot);
+}
+#endif /* CONFIG_RAD_TX_SLOTS */
+
 #if CONFIG_RAD_TX_RAD
 static inline int rad_tx_rad_blast(const struct device *dev, const rad_msg_rad_t *msg)
 {
@@ -59,11 +59,23 @@ extern "C" {
 #define RAD_MSG_TYPE_LASER_X_1_BIT_LEN_US       (RAD_MSG_TYPE_LASER_X_SPACE_PULSE_LEN_US + \
                                                   RAD_MSG_TYPE_LASER_X_1_PULSE_LEN_US)
 
+/**
+ * The learned message type has no fixed timing. Its description is inferred at runtime from
+ * captured frames (see rad_learn.h) so only its upper bounds are known at build time.
+ */
+#if CONFIG_RAD_MSG_TYPE_LEARNED
+#define RAD_MSG_TYPE_LEARNED_MAX_BITS           CONFIG_RAD_MSG_TYPE_LEARNED_MAX_BITS
+#define RAD_MSG_TYPE_LEARNED_LEN_PULSES         (1 + (2 * RAD_MSG_TYPE_LEARNED_MAX_BITS))
+#define RAD_MSG_TYPE_LEARNED_LINE_CLEAR_LEN_US  CONFIG_RAD_MSG_TYPE_LEARNED_LINE_CLEAR_LEN_US
+#define RAD_MSG_TYPE_LEARNED_NUM_WORDS          DIV_ROUND_UP(RAD_MSG_TYPE_LEARNED_MAX_BITS, 32)
+#endif
+
 typedef enum
 {
 	RAD_MSG_TYPE_RAD,
 	RAD_MSG_TYPE_DYNASTY,
 	RAD_MSG_TYPE_LASER_X,
+	RAD_MSG_TYPE_LEARNED,
 	RAD_MSG_TYPE_COUNT
 } rad_msg_type_t;
 
@@ -118,6 +130,32 @@ typedef struct
 } rad_msg_dynasty_t;
 #endif /* CONFIG_RAD_MSG_TYPE_DYNASTY */
 
+#if CONFIG_RAD_MSG_TYPE_LEARNED
+typedef struct
+{
+	uint8_t  len_bits;
+	/* Consecutive groups of 32 bits (fewer in the last word), most significant bit first. */
+	uint32_t words[RAD_MSG_TYPE_LEARNED_NUM_WORDS];
+} rad_msg_learned_t;
+#endif /* CONFIG_RAD_MSG_TYPE_LEARNED */
+
+/* Large enough to hold any of the enabled message types. */
+typedef union
+{
+#if CONFIG_RAD_MSG_TYPE_RAD
+    rad_msg_rad_t     rad;
+#endif
+#if CONFIG_RAD_MSG_TYPE_DYNASTY
+    rad_msg_dynasty_t dynasty;
+#endif
+#if CONFIG_RAD_MSG_TYPE_LASER_X
+    rad_msg_laser_x_t laser_x;
+#endif
+#if CONFIG_RAD_MSG_TYPE_LEARNED
+    rad_msg_learned_t learned;
+#endif
+} rad_msg_t;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,98 @@
+/**
+ * @file rad_learn.h
+ *
+ * @brief Inferring the timing of an unknown blaster from captured frames
+ */
+
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#ifndef ZEPHYR_INCLUDE_RAD_LEARN_H_
+#define ZEPHYR_INCLUDE_RAD_LEARN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr.h>
+
+#include <rad.h>
+#include <rad_protocol.h>
+
+/**
+ * Frames from repeated shots of the same blaster, e.g. pulse trains recorded with
+ * CONFIG_RAD_RX_RECORD, are added one at a time. Only a histogram of the pulse lengths of each
+ * polarity is kept so any number of frames can be added. The histogram of each polarity is
+ * then split into the two clusters that are furthest apart:
+ *     Only the inactive pulses vary:  pulse distance, two pulses per bit (e.g. Rad)
+ *     Only the active pulses vary:    pulse width, two pulses per bit (e.g. Laser X)
+ *     Both vary:                      pulse length, one pulse per bit (e.g. Dynasty)
+ * The shorter symbol is taken to be 0. Every bit of the frame is reported so fields, checks
+ * and fixed values are left to whoever turns the description into a rad_msg_type library.
+ */
+#define RAD_LEARN_BIN_US       20  /* Resolution of the histograms. */
+#define RAD_LEARN_MIN_GAP_US   200 /* Symbol pulses closer than this are the same symbol. */
+#define RAD_LEARN_MAX_PULSE_US RAD_MSG_TYPE_LEARNED_LINE_CLEAR_LEN_US
+#define RAD_LEARN_NUM_BINS     DIV_ROUND_UP(RAD_LEARN_MAX_PULSE_US, RAD_LEARN_BIN_US)
+
+struct rad_learn {
+    uint16_t len;          /* Pulses per frame, set by the first frame. */
+    uint16_t frames;       /* Frames added so far. */
+    uint32_t start_sum_us;
+    uint16_t histogram[2][RAD_LEARN_NUM_BINS]; /* Bit pulses, indexed by [active][bin]. */
+};
+
+/* A message type description as inferred by rad_learn_finish. */
+struct rad_learn_result {
+    uint16_t start_pulse_len_us;
+    uint8_t  pulses_per_bit;
+    uint16_t symbol_len_us[2][RAD_PROTOCOL_MAX_PULSES_PER_BIT];
+    uint8_t  len_bits;
+    uint16_t frames;       /* Frames that the description was learned from. */
+};
+
+/**
+ * @brief Start learning a new message type.
+ */
+void rad_learn_init(struct rad_learn *learn);
+
+/**
+ * @brief Add a captured frame.
+ *
+ * @param pulses_us Pulse lengths in microseconds starting with the start pulse, as in
+ *                  struct rad_rx_record.
+ * @param len       Number of pulses.
+ *
+ * @return 0 on success. The frame is ignored and a negative error code is returned if it is
+ *         too short (-EINVAL), too long for CONFIG_RAD_MSG_TYPE_LEARNED_MAX_BITS (-E2BIG),
+ *         not as long as the first frame (-EMSGSIZE), or it contains a bit pulse as long as
+ *         the line clear time (-ERANGE).
+ */
+int rad_learn_add(struct rad_learn *learn, const uint16_t *pulses_us, size_t len);
+
+/**
+ * @brief Infer a message type description from the frames added so far.
+ *
+ * @return 0 on success, -ENODATA if no frame was added or the frames don't contain both
+ *         symbols, -EINVAL if the pulses don't fit any of the supported encodings.
+ */
+int rad_learn_finish(const struct rad_learn *learn, struct rad_learn_result *result);
+
+/**
+ * @brief Describe RAD_MSG_TYPE_LEARNED.
+ *
+ * Receivers with CONFIG_RAD_RX_ACCEPT_LEARNED decode the new message type from their next
+ * frame on and report it as a rad_msg_learned_t. A frame that is being received while the
+ * description changes may be rejected.
+ *
+ * @return 0 on success, -EINVAL if the description can't be used.
+ */
+int rad_msg_type_learned_set(const struct rad_learn_result *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_RAD_LEARN_H_ */
@@ -0,0 +1,243 @@
+/**
+ * @file rad_protocol.h
+ *
+ * @brief Table-driven engine shared by the Rad message type libraries
+ */
+
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#ifndef ZEPHYR_INCLUDE_RAD_PROTOCOL_H_
+#define ZEPHYR_INCLUDE_RAD_PROTOCOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr.h>
+#include <device.h>
+
+#include <rad.h>
+
+/**
+ * Every supported message is an active start pulse followed by a fixed number of bits. The
+ * pulses alternate between inactive and active so the first pulse of the first bit is always
+ * inactive. A bit is made of one or two pulses and each of the two possible symbols (0 and 1)
+ * is described by the lengths of those pulses, e.g.:
+ *     Pulse distance (Rad):     {{390, 390}, {780, 390}}
+ *     Pulse width (Laser X):    {{450, 550}, {450, 1525}}
+ *     Pulse length (Dynasty):   {{412}, {747}}
+ *
+ * The bits are grouped into fields. A fixed field (e.g. a preamble) is checked one bit at a
+ * time and any other field can have a check that runs as soon as the field is complete.
+ */
+#define RAD_PROTOCOL_MAX_FIELDS         6
+#define RAD_PROTOCOL_MAX_PULSES_PER_BIT 2
+
+/* Fields are sent least significant bit first instead of most significant bit first. */
+#define RAD_PROTOCOL_FLAG_LSB_FIRST     BIT(0)
+/* A bit that doesn't match either symbol is a zero instead of invalidating the message. */
+#define RAD_PROTOCOL_FLAG_DEFAULT_0     BIT(1)
+/* A message that fails its checks can be repaired by flipping its most marginal bits. */
+#define RAD_PROTOCOL_FLAG_REPAIR        BIT(2)
+
+/* Number of marginal bits that are kept as candidates for RAD_PROTOCOL_FLAG_REPAIR. */
+#define RAD_PROTOCOL_MAX_WEAK_BITS      4
+
+typedef enum
+{
+    RAD_PARSE_STATE_WAIT_FOR_START_PULSE, /* A valid start pulse is required before parsing. */
+    RAD_PARSE_STATE_INCOMPLETE,           /* Not enough of the message has been received. */
+    RAD_PARSE_STATE_INVALID,              /* The message is not going to work out. */
+    RAD_PARSE_STATE_VALID,                /* The message is valid. */
+    RAD_PARSE_STATE_COUNT
+} rad_parse_state_t;
+
+/* Why rad_protocol_parse_pulse returned RAD_PARSE_STATE_INVALID. */
+typedef enum
+{
+    RAD_PARSE_REJECT_START,     /* The first pulse isn't the start pulse. */
+    RAD_PARSE_REJECT_SYMBOL,    /* A pulse doesn't belong to either symbol. */
+    RAD_PARSE_REJECT_FIELD,     /* A fixed field (e.g. a preamble) or a field check failed. */
+    RAD_PARSE_REJECT_CHECK,     /* The complete message failed to unpack (e.g. its checksum). */
+    RAD_PARSE_REJECT_LENGTH,    /* The frame goes on after the message is complete. */
+    RAD_PARSE_REJECT_TRUNCATED, /* The line cleared before the message was complete. */
+    RAD_PARSE_REJECT_COUNT
+} rad_parse_reject_t;
+
+/* Range of accepted pulse lengths in receiver capture ticks (see RAD_RX_WINDOW). */
+typedef struct
+{
+    uint32_t min;
+    uint32_t max;
+} rad_window_t;
+
+typedef struct
+{
+    uint8_t  width;                   /* Number of bits. */
+    bool     fixed;                   /* The field must always contain 'value'. */
+    uint32_t value;
+    bool   (*is_valid)(uint32_t value); /* Optional check once the field is complete. */
+} rad_field_t;
+
+struct rad_protocol {
+    rad_msg_type_t     msg_type;
+    uint8_t            flags;
+    uint16_t           start_pulse_len_us;
+    uint16_t           line_clear_len_us;
+    uint8_t            pulses_per_bit;
+    uint16_t           symbol_len_us[2][RAD_PROTOCOL_MAX_PULSES_PER_BIT];
+    uint8_t            len_bits;
+    uint8_t            num_fields;
+    const rad_field_t *fields;
+
+#if CONFIG_RAD_RX
+    /* The start pulse and symbol lengths converted to acceptance windows at build time. */
+    rad_window_t       start_window;
+    rad_window_t       symbol_window[2][RAD_PROTOCOL_MAX_PULSES_PER_BIT];
+#endif
+
+    /* Converts received fields into a message. Returns false if the message is invalid. */
+    bool (*unpack)(const uint32_t *fields, void *msg);
+
+    /* Converts a message into fields (fixed fields are filled in by the engine). */
+    int  (*pack)(const void *msg, uint32_t *fields);
+};
+
+#define RAD_PROTOCOL_LEN_PULSES(protocol) (1 + ((protocol)->len_bits * (protocol)->pulses_per_bit))
+
+/**
+ * Parser state for rad_protocol_parse_pulse. The parser is fed one pulse at a time, starting
+ * with the start pulse, and the caller stores the returned state. A message is rejected on the
+ * first pulse that can't belong to it and RAD_PARSE_STATE_VALID is returned exactly when the
+ * final pulse of a valid message arrives.
+ */
+typedef struct
+{
+    rad_parse_state_t state;
+    uint16_t          index;      /* Number of pulses consumed so far. */
+    uint8_t           pulse;      /* Pulse within the current bit. */
+    uint8_t           symbols;    /* Symbols that the current bit can still be. */
+    uint8_t           field;      /* Field that is currently being received. */
+    uint8_t           field_bits; /* Number of bits of the current field received so far. */
+    uint32_t          fields[RAD_PROTOCOL_MAX_FIELDS];
+    uint8_t           reject;     /* rad_parse_reject_t once the message is invalid. */
+#if CONFIG_RAD_RX_SOFT_DECISION
+    uint8_t           bit_reliability; /* Reliability of the current bit so far (0-255). */
+    uint32_t          reliability;     /* Sum of the reliabilities of the bits so far. */
+#endif
+#if CONFIG_RAD_RX_REPAIR
+    uint32_t          bit_margin; /* Distance of the current bit from the symbol threshold. */
+    uint8_t           num_weak;
+    bool              damaged;    /* A field check failed, leave it to the repair stage. */
+    uint8_t           repaired;   /* Number of bits that were flipped by the repair stage. */
+    struct {
+        uint8_t  field;
+        uint8_t  bit;
+        uint32_t margin;
+    } weak[RAD_PROTOCOL_MAX_WEAK_BITS]; /* Most marginal bits of the message, most first. */
+#endif
+#if CONFIG_RAD_RX_DRIFT_COMPENSATION
+    uint32_t          bit_len;    /* Measured length of the current bit so far. */
+    uint32_t          nominal;    /* Expected length of the pulses used for the estimate. */
+    uint32_t          measured;   /* Measured length of the same pulses. */
+    uint32_t          scale;      /* nominal / measured in Q16. */
+#endif
+} rad_parser_t;
+
+static inline void rad_parser_reset(rad_parser_t *parser)
+{
+    parser->state = RAD_PARSE_STATE_WAIT_FOR_START_PULSE;
+    parser->index = 0;
+}
+
+/**
+ * @brief Confidence in the message that was just parsed, from 0 (every bit was a guess) to 100.
+ *
+ * Only meaningful once rad_protocol_parse_pulse has returned RAD_PARSE_STATE_VALID. Always 100
+ * unless CONFIG_RAD_RX_SOFT_DECISION is enabled.
+ */
+static inline uint8_t rad_parser_confidence(const struct rad_protocol *protocol,
+                                            const rad_parser_t *parser)
+{
+#if CONFIG_RAD_RX_SOFT_DECISION
+    return (uint8_t)((parser->reliability * 100) / (protocol->len_bits * UINT8_MAX));
+#else
+    return 100;
+#endif
+}
+
+/**
+ * @brief Number of bits that had to be flipped to make the message that was just parsed valid.
+ */
+static inline uint8_t rad_parser_repaired(const rad_parser_t *parser)
+{
+#if CONFIG_RAD_RX_REPAIR
+    return parser->repaired;
+#else
+    return 0;
+#endif
+}
+
+#if CONFIG_RAD_MSG_TYPE_RAD
+extern const struct rad_protocol rad_msg_type_rad_protocol;
+#endif
+#if CONFIG_RAD_MSG_TYPE_DYNASTY
+extern const struct rad_protocol rad_msg_type_dynasty_protocol;
+#endif
+#if CONFIG_RAD_MSG_TYPE_LASER_X
+extern const struct rad_protocol rad_msg_type_laser_x_protocol;
+#endif
+#if CONFIG_RAD_MSG_TYPE_LEARNED
+/* Not const: it is described at runtime by rad_msg_type_learned_set (see rad_learn.h). */
+extern struct rad_protocol rad_msg_type_learned_protocol;
+#endif
+
+#if CONFIG_RAD_RX
+/**
+ * @brief Feed the next pulse of a frame to a parser.
+ *
+ * @param protocol The message type to parse.
+ * @param parser   Parser state, reset with rad_parser_reset at the start of each frame.
+ * @param pulse    Length of the pulse in capture ticks (see RAD_RX_TICKS_PER_SEC).
+ * @param msg      Written with the message when RAD_PARSE_STATE_VALID is returned.
+ */
+rad_parse_state_t rad_protocol_parse_pulse(const struct rad_protocol *protocol,
+                                             rad_parser_t *parser,
+                                             uint32_t pulse,
+                                             void *msg);
+#endif /* CONFIG_RAD_RX */
+
+#if CONFIG_RAD_TX
+/**
+ * An encoded frame is a list of runs. Each run is a number of carrier periods (PWM values of
+ * RAD_TX_PWM_VALUE_LEN_US) during which the LED is either modulated or off, and the
+ * transmitter expands the runs into PWM values while the frame plays.
+ */
+typedef uint16_t rad_run_t;
+
+#define RAD_RUN_ACTIVE         BIT(15)
+#define RAD_RUN(active, len)   ((rad_run_t)(((active) ? RAD_RUN_ACTIVE : 0) | (len)))
+#define RAD_RUN_LEN(run)       ((uint32_t)((run) & ~RAD_RUN_ACTIVE))
+
+/**
+ * @brief Encode a message into runs.
+ *
+ * @param protocol The message type to encode.
+ * @param msg      The message.
+ * @param runs     Buffer for the runs.
+ * @param len      Size of the buffer on input and number of runs used on output.
+ */
+int rad_protocol_encode(const struct rad_protocol *protocol,
+                          const void *msg,
+                          rad_run_t *runs,
+                          uint32_t *len);
+#endif /* CONFIG_RAD_TX */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_RAD_PROTOCOL_H_ */
@@ -0,0 +1,59 @@
+/**
+ * @file rad_trace.h
+ *
+ * @brief Tracepoints of the Rad receive and transmit pipeline
+ */
+
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#ifndef ZEPHYR_INCLUDE_RAD_TRACE_H_
+#define ZEPHYR_INCLUDE_RAD_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr.h>
+
+/* Device id of deliveries to the callback of a receiver group. */
+#define RAD_TRACE_ID_GROUP 0xFF
+
+#if CONFIG_RAD_TRACING
+/**
+ * Every tracepoint carries the id of the device: the 'sensor-id' of a receiver or the instance
+ * number of a transmitter. The default implementations emit CTF events when the CTF tracing
+ * backend is used and do nothing otherwise. They are weak so that an application can forward
+ * them to any other backend.
+ */
+void sys_trace_rad_rx_edge(uint8_t dev_id);          /* Edge interrupt of a receiver. */
+void sys_trace_rad_rx_work_submit(uint8_t dev_id);   /* Decoding submitted at the end of a pulse. */
+void sys_trace_rad_rx_decode_enter(uint8_t dev_id);  /* Decoding work started. */
+void sys_trace_rad_rx_decode_exit(uint8_t dev_id);   /* Decoding work done. */
+void sys_trace_rad_rx_parse(uint8_t dev_id,          /* A message type accepted or rejected a frame. */
+                            uint8_t msg_type,
+                            uint8_t state);
+void sys_trace_rad_rx_callback(uint8_t dev_id,       /* A callback is about to be called. */
+                               uint8_t msg_type);
+void sys_trace_rad_tx_start(uint8_t dev_id,          /* A blast started playing. */
+                            uint8_t msg_type);
+void sys_trace_rad_tx_stopped(uint8_t dev_id,        /* A blast finished playing. */
+                              uint8_t msg_type);
+#else
+#define sys_trace_rad_rx_edge(dev_id)
+#define sys_trace_rad_rx_work_submit(dev_id)
+#define sys_trace_rad_rx_decode_enter(dev_id)
+#define sys_trace_rad_rx_decode_exit(dev_id)
+#define sys_trace_rad_rx_parse(dev_id, msg_type, state)
+#define sys_trace_rad_rx_callback(dev_id, msg_type)
+#define sys_trace_rad_tx_start(dev_id, msg_type)
+#define sys_trace_rad_tx_stopped(dev_id, msg_type)
+#endif /* CONFIG_RAD_TRACING */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_RAD_TRACE_H_ */
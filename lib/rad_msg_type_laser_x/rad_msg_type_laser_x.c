@@ -7,123 +7,99 @@
 #include <sys/util.h>
 #include <logging/log.h>
 
-#if CONFIG_RAD_MSG_TYPE_DYNASTY
+#include <rad_protocol.h>
+#if CONFIG_RAD_RX
+#include <drivers/rad_rx.h>
+#endif
+
+#define COMMON_PREFIX     0x14 /* 0b010100 */
+#define COMMON_PREFIX_LEN 6
+#define TEAM_ID_LEN       (RAD_MSG_TYPE_LASER_X_LEN_IR_BITS - COMMON_PREFIX_LEN)
+#define TEAM_ID_MASK      (BIT(TEAM_ID_LEN) - 1)
+
+#if CONFIG_RAD_MSG_TYPE_LASER_X
 LOG_MODULE_REGISTER(rad_message_type_laser_x, CONFIG_RAD_MSG_TYPE_LASER_X_LOG_LEVEL);
 
-#if CONFIG_RAD_RX_ACCEPT_LASER_X
-#include <drivers/rad_rx.h>
+/**
+ * Each message is a start pulse followed by eight bits:
+ *     START: Active pulse of ~5.95ms
+ *     0:     Inactive for ~0.45ms followed by an active pulse of ~0.55ms
+ *     1:     Inactive for ~0.45ms followed by an active pulse of ~1.5ms
+ *
+ * The eight bits are the team ID, most significant bit first. Every team ID starts with the
+ * same six bits so only the last two bits vary.
+ */
+enum {
+    FIELD_PREFIX,
+    FIELD_TEAM_ID,
+    FIELD_COUNT
+};
 
-rad_parse_state_t rad_msg_type_laser_x_parse(uint32_t          *message,
-                                             uint32_t           len,
-                                             rad_msg_laser_x_t *msg)
+static bool team_id_is_valid(uint32_t value)
 {
-    /**
-     * NOTE: The start pulse length is validated before this function is called so
-     *       parsing effectively starts at index 1.
-     *
-     * NOTE: Message len is validated before calling this function.
-     *
-     * Each message is a start pulse followed by eight bits:
-     *     START: Active pulse of ~5.95ms
-     *     0:     Inactive for ~0.45ms followed by an active pulse of ~0.55ms
-     *     1:     Inactive for ~0.45ms followed by an active pulse of ~1.5ms
-     */
-    msg->team_id = 0;
-    for (int i=1,j=7; j>=0; i+=2,j--) {
-        if (IS_VALID_BIT_PULSE(message[i], RAD_MSG_TYPE_LASER_X_SPACE_PULSE_LEN_US)) {
-            if (IS_VALID_BIT_PULSE(message[i+1], RAD_MSG_TYPE_LASER_X_0_PULSE_LEN_US)) {
-                // This is a zero bit.
-                continue;
-            } else if (IS_VALID_BIT_PULSE(message[i+1], RAD_MSG_TYPE_LASER_X_1_PULSE_LEN_US)) {
-                // This is a one bit.
-                msg->team_id |= (1<<j);
-                continue;
-            }
-        }
-        return RAD_PARSE_STATE_INVALID;
-    }
-
-    switch (msg->team_id) {
+    switch ((COMMON_PREFIX << TEAM_ID_LEN) | value) {
     case TEAM_ID_LASER_X_BLUE:
     case TEAM_ID_LASER_X_RED:
     case TEAM_ID_LASER_X_NEUTRAL:
-        return RAD_PARSE_STATE_VALID;
+        return true;
     default:
-        return RAD_PARSE_STATE_VALID;
+        return false;
     }
 }
-#endif /* CONFIG_RAD_RX_ACCEPT_LASER_X */
-
-#if CONFIG_RAD_TX_LASER_X
-#include <drivers/rad_tx.h>
 
-#define ADD_0_BIT(p_values) do { \
-for (int i=0; i < RAD_TX_LASER_X_SPACE_PULSE_PWM_VALUES; i++) \
-{ \
-    *p_values++ = RAD_TX_DUTY_CYCLE_0; \
-} \
-for (int i=0; i < RAD_TX_LASER_X_0_PULSE_LEN_PWM_VALUES; i++) { \
-    *p_values++ = RAD_TX_DUTY_CYCLE_50; \
-} \
-} while (0)
+static const rad_field_t m_fields[FIELD_COUNT] = {
+    [FIELD_PREFIX]  = { .width = COMMON_PREFIX_LEN, .fixed = true, .value = COMMON_PREFIX },
+    [FIELD_TEAM_ID] = { .width = TEAM_ID_LEN, .is_valid = team_id_is_valid },
+};
 
-#define ADD_1_BIT(p_values) do { \
-for (int i=0; i < RAD_TX_LASER_X_SPACE_PULSE_PWM_VALUES; i++) \
-{ \
-    *p_values++ = RAD_TX_DUTY_CYCLE_0; \
-} \
-for (int i=0; i < RAD_TX_LASER_X_1_PULSE_LEN_PWM_VALUES; i++) { \
-    *p_values++ = RAD_TX_DUTY_CYCLE_50; \
-} \
-} while (0)
-
-int rad_msg_type_laser_x_encode(const rad_msg_laser_x_t *msg,
-                                  nrf_pwm_values_common_t *values,
-                                  uint32_t *len)
+static bool unpack(const uint32_t *fields, void *msg)
 {
-    nrf_pwm_values_common_t *p_values = values;
+    rad_msg_laser_x_t *p_msg = msg;
 
-    if (*len < RAD_TX_LASER_X_MAX_MSG_LEN_PWM_VALUES) {
-        return -ENOMEM;
-    }
-
-    for (int i=0; i < RAD_TX_LASER_X_START_PULSE_LEN_PWM_VALUES; i++) {
-        *p_values = RAD_TX_DUTY_CYCLE_50;
-        p_values++;
-    }
+    p_msg->team_id = ((fields[FIELD_PREFIX] << TEAM_ID_LEN) | fields[FIELD_TEAM_ID]);
+    return true;
+}
 
-    // Add the common prefix.
-    ADD_0_BIT(p_values);
-    ADD_1_BIT(p_values);
-    ADD_0_BIT(p_values);
-    ADD_1_BIT(p_values);
-    ADD_0_BIT(p_values);
-    ADD_0_BIT(p_values);
+static int pack(const void *msg, uint32_t *fields)
+{
+    const rad_msg_laser_x_t *p_msg = msg;
 
-    switch (msg->team_id) {
-    case TEAM_ID_LASER_X_RED:
-        ADD_1_BIT(p_values);
-        ADD_0_BIT(p_values);
-        break;
-    case TEAM_ID_LASER_X_BLUE:
-        ADD_0_BIT(p_values);
-        ADD_1_BIT(p_values);
-        break;
-    case TEAM_ID_LASER_X_NEUTRAL:
-        ADD_1_BIT(p_values);
-        ADD_1_BIT(p_values);
-        break;
-    default:
+    if (((p_msg->team_id >> TEAM_ID_LEN) != COMMON_PREFIX) ||
+          !team_id_is_valid(p_msg->team_id & TEAM_ID_MASK)) {
         return -1;
     }
 
-    *p_values = RAD_TX_DUTY_CYCLE_0;
-    p_values++;
-
-    *len = (p_values - values);
+    fields[FIELD_TEAM_ID] = (p_msg->team_id & TEAM_ID_MASK);
     return 0;
 }
 
-#endif /* CONFIG_RAD_TX_LASER_X */
-
-#endif /* CONFIG_RAD_MSG_TYPE_DYNASTY */
+const struct rad_protocol rad_msg_type_laser_x_protocol = {
+    .msg_type           = RAD_MSG_TYPE_LASER_X,
+    .start_pulse_len_us = RAD_MSG_TYPE_LASER_X_START_PULSE_LEN_US,
+    .line_clear_len_us  = RAD_MSG_TYPE_LASER_X_LINE_CLEAR_LEN_US,
+    .pulses_per_bit     = 2,
+    .symbol_len_us      = {
+        { RAD_MSG_TYPE_LASER_X_SPACE_PULSE_LEN_US, RAD_MSG_TYPE_LASER_X_0_PULSE_LEN_US },
+        { RAD_MSG_TYPE_LASER_X_SPACE_PULSE_LEN_US, RAD_MSG_TYPE_LASER_X_1_PULSE_LEN_US },
+    },
+    .len_bits           = RAD_MSG_TYPE_LASER_X_LEN_IR_BITS,
+    .num_fields         = FIELD_COUNT,
+    .fields             = m_fields,
+#if CONFIG_RAD_RX
+    .start_window       = RAD_RX_START_WINDOW(RAD_MSG_TYPE_LASER_X_START_PULSE_LEN_US),
+    .symbol_window      = {
+        {
+            RAD_RX_BIT_WINDOW(RAD_MSG_TYPE_LASER_X_SPACE_PULSE_LEN_US),
+            RAD_RX_BIT_WINDOW(RAD_MSG_TYPE_LASER_X_0_PULSE_LEN_US),
+        },
+        {
+            RAD_RX_BIT_WINDOW(RAD_MSG_TYPE_LASER_X_SPACE_PULSE_LEN_US),
+            RAD_RX_BIT_WINDOW(RAD_MSG_TYPE_LASER_X_1_PULSE_LEN_US),
+        },
+    },
+#endif
+    .unpack             = unpack,
+    .pack               = pack,
+};
+
+#endif /* CONFIG_RAD_MSG_TYPE_LASER_X */
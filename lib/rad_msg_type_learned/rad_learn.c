@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+#include <zephyr.h>
+#include <sys/util.h>
+#include <logging/log.h>
+
+#include <rad_learn.h>
+
+#if CONFIG_RAD_MSG_TYPE_LEARNED
+LOG_MODULE_DECLARE(rad_message_type_learned, CONFIG_RAD_MSG_TYPE_LEARNED_LOG_LEVEL);
+
+/* Lengths are measured from the middle of each histogram bin. */
+#define BIN_CENTER_US(bin) (((bin) * RAD_LEARN_BIN_US) + (RAD_LEARN_BIN_US / 2))
+
+struct clusters {
+    bool     split;   /* The pulses form two clusters at least RAD_LEARN_MIN_GAP_US apart. */
+    uint16_t len_us[2]; /* Mean of the shorter and the longer cluster, or of all pulses twice. */
+};
+
+void rad_learn_init(struct rad_learn *learn)
+{
+    memset(learn, 0, sizeof(*learn));
+}
+
+int rad_learn_add(struct rad_learn *learn, const uint16_t *pulses_us, size_t len)
+{
+    if ((NULL == pulses_us) || (len < 3)) {
+        return -EINVAL;
+    }
+
+    if ((2 * RAD_MSG_TYPE_LEARNED_MAX_BITS) < (len - 1)) {
+        return -E2BIG;
+    }
+
+    if (learn->frames && (len != learn->len)) {
+        /* A collision, a truncated frame or another blaster. */
+        return -EMSGSIZE;
+    }
+
+    for (size_t i=1; i < len; i++) {
+        if (RAD_LEARN_MAX_PULSE_US <= pulses_us[i]) {
+            return -ERANGE;
+        }
+    }
+
+    for (size_t i=1; i < len; i++) {
+        /* The start pulse is active so the pulses at odd indices are inactive. */
+        uint16_t *count = &learn->histogram[(i % 2) ? 0 : 1][pulses_us[i] / RAD_LEARN_BIN_US];
+
+        if (*count < UINT16_MAX) {
+            (*count)++;
+        }
+    }
+
+    learn->len           = len;
+    learn->frames       += 1;
+    learn->start_sum_us += pulses_us[0];
+    return 0;
+}
+
+static void clusters_find(const uint16_t *histogram, struct clusters *clusters)
+{
+    /**
+     * Otsu's method: the threshold that maximizes the variance between the two clusters, i.e.
+     * w0 * w1 * (m1 - m0)^2, also minimizes the spread within each of them.
+     */
+    uint64_t best  = 0;
+    uint64_t sum   = 0;
+    uint64_t sum0  = 0;
+    uint32_t count = 0;
+    uint32_t w0    = 0;
+
+    for (int i=0; i < RAD_LEARN_NUM_BINS; i++) {
+        count += histogram[i];
+        sum   += ((uint64_t)histogram[i] * BIN_CENTER_US(i));
+    }
+
+    clusters->split     = false;
+    clusters->len_us[0] = (count ? (uint16_t)(sum / count) : 0);
+    clusters->len_us[1] = clusters->len_us[0];
+
+    for (int i=0; i < (RAD_LEARN_NUM_BINS - 1); i++) {
+        uint32_t w1;
+        uint32_t m0;
+        uint32_t m1;
+        uint64_t between;
+
+        w0   += histogram[i];
+        sum0 += ((uint64_t)histogram[i] * BIN_CENTER_US(i));
+        w1    = (count - w0);
+
+        if ((0 == w0) || (0 == w1)) {
+            continue;
+        }
+
+        m0      = (uint32_t)(sum0 / w0);
+        m1      = (uint32_t)((sum - sum0) / w1);
+        between = ((((uint64_t)w0 * w1) / count) * (m1 - m0) * (m1 - m0));
+
+        if (best < between) {
+            best                = between;
+            clusters->split     = ((m1 - m0) >= RAD_LEARN_MIN_GAP_US);
+            clusters->len_us[0] = m0;
+            clusters->len_us[1] = m1;
+        }
+    }
+
+    if (!clusters->split) {
+        clusters->len_us[0] = (count ? (uint16_t)(sum / count) : 0);
+        clusters->len_us[1] = clusters->len_us[0];
+    }
+}
+
+int rad_learn_finish(const struct rad_learn *learn, struct rad_learn_result *result)
+{
+    struct clusters inactive;
+    struct clusters active;
+    uint32_t        bit_pulses;
+
+    if (0 == learn->frames) {
+        return -ENODATA;
+    }
+
+    clusters_find(learn->histogram[0], &inactive);
+    clusters_find(learn->histogram[1], &active);
+
+    memset(result, 0, sizeof(*result));
+    bit_pulses                 = (learn->len - 1);
+    result->frames             = learn->frames;
+    result->start_pulse_len_us = (uint16_t)(learn->start_sum_us / learn->frames);
+
+    if (inactive.split && active.split) {
+        /* Every pulse is a bit, whatever its polarity. */
+        uint16_t        both[RAD_LEARN_NUM_BINS];
+        struct clusters all;
+
+        for (int i=0; i < RAD_LEARN_NUM_BINS; i++) {
+            both[i] = MIN(UINT16_MAX, ((uint32_t)learn->histogram[0][i] + learn->histogram[1][i]));
+        }
+        clusters_find(both, &all);
+
+        result->pulses_per_bit      = 1;
+        result->len_bits            = bit_pulses;
+        result->symbol_len_us[0][0] = all.len_us[0];
+        result->symbol_len_us[1][0] = all.len_us[1];
+    } else if (inactive.split || active.split) {
+        /* Each bit is an inactive pulse followed by an active one and only one of them varies. */
+        if (bit_pulses % 2) {
+            return -EINVAL;
+        }
+
+        result->pulses_per_bit      = 2;
+        result->len_bits            = (bit_pulses / 2);
+        result->symbol_len_us[0][0] = inactive.len_us[0];
+        result->symbol_len_us[1][0] = inactive.len_us[1];
+        result->symbol_len_us[0][1] = active.len_us[0];
+        result->symbol_len_us[1][1] = active.len_us[1];
+    } else {
+        /* Every bit that was seen is the same symbol so the other one is unknown. */
+        LOG_WRN("Only one symbol in %u frame(s)", learn->frames);
+        return -ENODATA;
+    }
+
+    LOG_DBG("%u frame(s) of %u pulses", learn->frames, learn->len);
+    return 0;
+}
+
+#endif /* CONFIG_RAD_MSG_TYPE_LEARNED */
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+#include <zephyr.h>
+#include <sys/util.h>
+#include <logging/log.h>
+
+#include <rad_protocol.h>
+#include <rad_learn.h>
+#if CONFIG_RAD_RX
+#include <drivers/rad_rx.h>
+#endif
+
+#if CONFIG_RAD_MSG_TYPE_LEARNED
+LOG_MODULE_REGISTER(rad_message_type_learned, CONFIG_RAD_MSG_TYPE_LEARNED_LOG_LEVEL);
+
+BUILD_ASSERT(RAD_MSG_TYPE_LEARNED_NUM_WORDS <= RAD_PROTOCOL_MAX_FIELDS,
+             "CONFIG_RAD_MSG_TYPE_LEARNED_MAX_BITS doesn't fit in RAD_PROTOCOL_MAX_FIELDS fields");
+
+/**
+ * Nothing is known about the message until rad_msg_type_learned_set is called so every bit
+ * is data. The bits are split into fields of 32 bits, the last one shorter, which are reported
+ * as they are.
+ */
+static rad_field_t m_fields[RAD_MSG_TYPE_LEARNED_NUM_WORDS];
+
+static bool unpack(const uint32_t *fields, void *msg)
+{
+    rad_msg_learned_t *p_msg = msg;
+
+    /* Messages are compared whole, e.g. by rad_rx_group, so padding and unused words are zeroed. */
+    memset(p_msg, 0, sizeof(*p_msg));
+    p_msg->len_bits = rad_msg_type_learned_protocol.len_bits;
+    memcpy(p_msg->words, fields, (rad_msg_type_learned_protocol.num_fields * sizeof(uint32_t)));
+    return true;
+}
+
+static int pack(const void *msg, uint32_t *fields)
+{
+    const rad_msg_learned_t *p_msg = msg;
+
+    if (p_msg->len_bits != rad_msg_type_learned_protocol.len_bits) {
+        return -1;
+    }
+
+    memcpy(fields, p_msg->words, (rad_msg_type_learned_protocol.num_fields * sizeof(uint32_t)));
+    return 0;
+}
+
+struct rad_protocol rad_msg_type_learned_protocol = {
+    .msg_type           = RAD_MSG_TYPE_LEARNED,
+    .line_clear_len_us  = RAD_MSG_TYPE_LEARNED_LINE_CLEAR_LEN_US,
+    .pulses_per_bit     = 1,
+    .fields             = m_fields,
+#if CONFIG_RAD_RX
+    /* Can't match any pulse so every frame is rejected at its start pulse. */
+    .start_window       = { .min = UINT32_MAX, .max = 0 },
+#endif
+    .unpack             = unpack,
+    .pack               = pack,
+};
+
+int rad_msg_type_learned_set(const struct rad_learn_result *result)
+{
+    struct rad_protocol *protocol = &rad_msg_type_learned_protocol;
+
+    if ((NULL == result) ||
+        (0 == result->len_bits) || (RAD_MSG_TYPE_LEARNED_MAX_BITS < result->len_bits) ||
+        (0 == result->pulses_per_bit) || (RAD_PROTOCOL_MAX_PULSES_PER_BIT < result->pulses_per_bit)) {
+        return -EINVAL;
+    }
+
+#if CONFIG_RAD_RX
+    if (result->start_pulse_len_us <= RAD_RX_START_PULSE_MARGIN_US) {
+        return -EINVAL;
+    }
+#endif
+
+    for (int j=0; j < 2; j++) {
+        for (int i=0; i < result->pulses_per_bit; i++) {
+            if (RAD_MSG_TYPE_LEARNED_LINE_CLEAR_LEN_US <= result->symbol_len_us[j][i]) {
+                /* The receiver would take the pulse for the end of the frame. */
+                return -EINVAL;
+            }
+#if CONFIG_RAD_RX
+            if (result->symbol_len_us[j][i] <= RAD_RX_BIT_MARGIN_US) {
+                return -EINVAL;
+            }
+#endif
+        }
+    }
+
+#if CONFIG_RAD_RX
+    /* Stop new frames from being parsed with a half-written description. */
+    protocol->start_window.min = UINT32_MAX;
+    protocol->start_window.max = 0;
+    compiler_barrier();
+#endif
+
+    protocol->pulses_per_bit     = result->pulses_per_bit;
+    protocol->start_pulse_len_us = result->start_pulse_len_us;
+    protocol->len_bits           = result->len_bits;
+    protocol->num_fields         = DIV_ROUND_UP(result->len_bits, 32);
+
+    for (int i=0; i < protocol->num_fields; i++) {
+        m_fields[i].width = MIN(32, (result->len_bits - (32 * i)));
+    }
+
+    for (int j=0; j < 2; j++) {
+        for (int i=0; i < result->pulses_per_bit; i++) {
+            protocol->symbol_len_us[j][i] = result->symbol_len_us[j][i];
+#if CONFIG_RAD_RX
+            protocol->symbol_window[j][i] = (rad_window_t)RAD_RX_BIT_WINDOW(result->symbol_len_us[j][i]);
+#endif
+        }
+    }
+
+#if CONFIG_RAD_RX
+    compiler_barrier();
+    protocol->start_window = (rad_window_t)RAD_RX_START_WINDOW(result->start_pulse_len_us);
+#endif
+
+    LOG_INF("Learned %u bits, start %u us, %u pulse(s) per bit, 0: {%u, %u} us, 1: {%u, %u} us",
+            result->len_bits, result->start_pulse_len_us, result->pulses_per_bit,
+            result->symbol_len_us[0][0], result->symbol_len_us[0][1],
+            result->symbol_len_us[1][0], result->symbol_len_us[1][1]);
+    return 0;
+}
+
+#endif /* CONFIG_RAD_MSG_TYPE_LEARNED */
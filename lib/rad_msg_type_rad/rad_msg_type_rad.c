@@ -7,208 +7,98 @@
 #include <sys/util.h>
 #include <logging/log.h>
 
-#include <drivers/rad_tx.h>
+#include <rad_protocol.h>
+#if CONFIG_RAD_RX
+#include <drivers/rad_rx.h>
+#endif
 
 #if CONFIG_RAD_MSG_TYPE_RAD
 LOG_MODULE_REGISTER(rad_message_type_rad, CONFIG_RAD_MSG_TYPE_RAD_LOG_LEVEL);
 
-#if CONFIG_RAD_RX_ACCEPT_RAD
-#include <drivers/rad_rx.h>
-
-rad_parse_state_t rad_msg_type_rad_parse(uint32_t      *message,
-	                                     uint32_t       len,
-	                                     rad_msg_rad_t *msg)
+/**
+ * Each message is a start pulse followed by sixteen bits:
+ *     START: Active pulse of ~1.58ms (60 periods @ 38KHz)
+ *     0:     Inactive for ~0.39ms (15 periods) followed by an active pulse of ~0.39ms
+ *     1:     Inactive for ~0.78ms (30 periods) followed by an active pulse of ~0.39ms
+ *
+ * The fields are sent in this order, most significant bit first: version (2), team_id (2),
+ * player_id (4), special (4), damage (4).
+ */
+enum {
+    FIELD_VERSION,
+    FIELD_TEAM_ID,
+    FIELD_PLAYER_ID,
+    FIELD_SPECIAL,
+    FIELD_DAMAGE,
+    FIELD_COUNT
+};
+
+static const rad_field_t m_fields[FIELD_COUNT] = {
+    [FIELD_VERSION]   = { .width = 2, .fixed = true, .value = RAD_MSG_VERSION },
+    [FIELD_TEAM_ID]   = { .width = 2 },
+    [FIELD_PLAYER_ID] = { .width = 4 },
+    [FIELD_SPECIAL]   = { .width = 4 },
+    [FIELD_DAMAGE]    = { .width = 4 },
+};
+
+static bool unpack(const uint32_t *fields, void *msg)
 {
-    /**
-     * NOTE: The start pulse length is validated before this function is called so
-     *       parsing effectively starts at index 1.
-     *
-     * NOTE: Message len is validated before calling this function.
-     *
-     * Each message is a start pulse followed by sixteen bits:
-     *     START: Active pulse of ~1.58ms (60 periods @ 38KHz)
-     *     0:     Inactive for ~0.39ms (15 periods) followed by an active pulse of ~0.39ms
-     *     1:     Inactive for ~0.78ms (30 periods) followed by an active pulse of ~0.39ms
-     */
-	int i=1;
-
-	msg->version = 0;
-	for (int j=1; j>=0; i+=2,j--) {
-	    if (!IS_VALID_BIT_PULSE(message[i+1], RAD_MSG_TYPE_RAD_ACTIVE_PULSE_LEN_US)) {
-	    	return RAD_PARSE_STATE_INVALID;
-	    }
-        if (IS_VALID_BIT_PULSE(message[i], RAD_MSG_TYPE_RAD_0_PULSE_LEN_US)) {
-            // This is a zero bit.
-        } else if (IS_VALID_BIT_PULSE(message[i], RAD_MSG_TYPE_RAD_1_PULSE_LEN_US)) {
-            // This is a one bit.
-            msg->version |= (1<<j);
-        } else {
-        	return RAD_PARSE_STATE_INVALID;
-        }
-	}
-
-    if (RAD_MSG_VERSION != msg->version) {
-        return RAD_PARSE_STATE_INVALID;
-    }
-
-	msg->team_id = 0;
-	for (int j=1; j>=0; i+=2,j--) {
-	    if (!IS_VALID_BIT_PULSE(message[i+1], RAD_MSG_TYPE_RAD_ACTIVE_PULSE_LEN_US)) {
-	    	return RAD_PARSE_STATE_INVALID;
-	    }
-        if (IS_VALID_BIT_PULSE(message[i], RAD_MSG_TYPE_RAD_0_PULSE_LEN_US)) {
-            // This is a zero bit.
-        } else if (IS_VALID_BIT_PULSE(message[i], RAD_MSG_TYPE_RAD_1_PULSE_LEN_US)) {
-            // This is a one bit.
-            msg->team_id |= (1<<j);
-        } else {
-        	return RAD_PARSE_STATE_INVALID;
-        }
-	}
-
-	msg->player_id = 0;
-	for (int j=3; j>=0; i+=2,j--) {
-	    if (!IS_VALID_BIT_PULSE(message[i+1], RAD_MSG_TYPE_RAD_ACTIVE_PULSE_LEN_US)) {
-	    	return RAD_PARSE_STATE_INVALID;
-	    }
-        if (IS_VALID_BIT_PULSE(message[i], RAD_MSG_TYPE_RAD_0_PULSE_LEN_US)) {
-            // This is a zero bit.
-        } else if (IS_VALID_BIT_PULSE(message[i], RAD_MSG_TYPE_RAD_1_PULSE_LEN_US)) {
-            // This is a one bit.
-            msg->player_id |= (1<<j);
-        } else {
-        	return RAD_PARSE_STATE_INVALID;
-        }
-	}
-
-	msg->special = 0;
-	for (int j=3; j>=0; i+=2,j--) {
-	    if (!IS_VALID_BIT_PULSE(message[i+1], RAD_MSG_TYPE_RAD_ACTIVE_PULSE_LEN_US)) {
-	    	return RAD_PARSE_STATE_INVALID;
-	    }
-        if (IS_VALID_BIT_PULSE(message[i], RAD_MSG_TYPE_RAD_0_PULSE_LEN_US)) {
-            // This is a zero bit.
-        } else if (IS_VALID_BIT_PULSE(message[i], RAD_MSG_TYPE_RAD_1_PULSE_LEN_US)) {
-            // This is a one bit.
-            msg->special |= (1<<j);
-        } else {
-        	return RAD_PARSE_STATE_INVALID;
-        }
-	}
-
-	msg->damage = 0;
-	for (int j=3; j>=0; i+=2,j--) {
-	    if (!IS_VALID_BIT_PULSE(message[i+1], RAD_MSG_TYPE_RAD_ACTIVE_PULSE_LEN_US)) {
-	    	return RAD_PARSE_STATE_INVALID;
-	    }
-        if (IS_VALID_BIT_PULSE(message[i], RAD_MSG_TYPE_RAD_0_PULSE_LEN_US)) {
-            // This is a zero bit.
-        } else if (IS_VALID_BIT_PULSE(message[i], RAD_MSG_TYPE_RAD_1_PULSE_LEN_US)) {
-            // This is a one bit.
-            msg->damage |= (1<<j);
-        } else {
-        	return RAD_PARSE_STATE_INVALID;
-        }
-	}
-
-	return RAD_PARSE_STATE_VALID;
+    rad_msg_rad_t *p_msg = msg;
+
+    p_msg->version   = fields[FIELD_VERSION];
+    p_msg->team_id   = fields[FIELD_TEAM_ID];
+    p_msg->player_id = fields[FIELD_PLAYER_ID];
+    p_msg->special   = fields[FIELD_SPECIAL];
+    p_msg->damage    = fields[FIELD_DAMAGE];
+    return true;
 }
 
-#endif /* CONFIG_RAD_RX_ACCEPT_RAD */
-
-#if CONFIG_RAD_TX_RAD
-#include <drivers/rad_tx.h>
-
-#define ADD_0_BIT(p_values) do { \
-for (int i=0; i < RAD_TX_RAD_0_PULSE_LEN_PWM_VALUES; i++) \
-{ \
-    *p_values++ = RAD_TX_DUTY_CYCLE_0; \
-} \
-for (int i=0; i < RAD_TX_RAD_ACTIVE_PULSE_LEN_PWM_VALUES; i++) { \
-    *p_values++ = RAD_TX_DUTY_CYCLE_50; \
-} \
-} while (0)
-
-#define ADD_1_BIT(p_values) do { \
-for (int i=0; i < RAD_TX_RAD_1_PULSE_LEN_PWM_VALUES; i++) \
-{ \
-    *p_values++ = RAD_TX_DUTY_CYCLE_0; \
-} \
-for (int i=0; i < RAD_TX_RAD_ACTIVE_PULSE_LEN_PWM_VALUES; i++) { \
-    *p_values++ = RAD_TX_DUTY_CYCLE_50; \
-} \
-} while (0)
-
-int rad_msg_type_rad_encode(const rad_msg_rad_t *msg,
-                              nrf_pwm_values_common_t *values,
-                              uint32_t *len)
+static int pack(const void *msg, uint32_t *fields)
 {
-    nrf_pwm_values_common_t *p_values = values;
-
-    if (*len < RAD_TX_RAD_MAX_MSG_LEN_PWM_VALUES) {
-        return -ENOMEM;
-    }
+    const rad_msg_rad_t *p_msg = msg;
 
     /**
      * Only one version of RAD message is defined/supported.
      * Creating a message without a version is allowed.
      */
-    if (msg->version && (RAD_MSG_VERSION != msg->version)) {
+    if (p_msg->version && (RAD_MSG_VERSION != p_msg->version)) {
         return -1;
     }
 
-    for (int i=0; i < RAD_TX_RAD_START_PULSE_LEN_PWM_VALUES; i++) {
-        *p_values = RAD_TX_DUTY_CYCLE_50;
-        p_values++;
-    }
-
-    for (int j=1; j>=0; j--) {
-        if (RAD_MSG_VERSION & (1<<j)) {
-            ADD_1_BIT(p_values);
-        } else {
-            ADD_0_BIT(p_values);
-        }
-    }
-
-    for (int j=1; j>=0; j--) {
-        if (msg->team_id & (1<<j)) {
-            ADD_1_BIT(p_values);
-        } else {
-            ADD_0_BIT(p_values);
-        }
-    }
-
-    for (int j=3; j>=0; j--) {
-        if (msg->player_id & (1<<j)) {
-            ADD_1_BIT(p_values);
-        } else {
-            ADD_0_BIT(p_values);
-        }
-    }
-
-    for (int j=3; j>=0; j--) {
-        if (msg->special & (1<<j)) {
-            ADD_1_BIT(p_values);
-        } else {
-            ADD_0_BIT(p_values);
-        }
-    }
-
-    for (int j=3; j>=0; j--) {
-        if (msg->damage & (1<<j)) {
-            ADD_1_BIT(p_values);
-        } else {
-            ADD_0_BIT(p_values);
-        }
-    }
-
-    *p_values = RAD_TX_DUTY_CYCLE_0;
-    p_values++;
-
-    *len = (p_values - values);
+    fields[FIELD_TEAM_ID]   = p_msg->team_id;
+    fields[FIELD_PLAYER_ID] = p_msg->player_id;
+    fields[FIELD_SPECIAL]   = p_msg->special;
+    fields[FIELD_DAMAGE]    = p_msg->damage;
     return 0;
 }
 
-#endif /* CONFIG_RAD_TX_RAD */
+const struct rad_protocol rad_msg_type_rad_protocol = {
+    .msg_type           = RAD_MSG_TYPE_RAD,
+    .start_pulse_len_us = RAD_MSG_TYPE_RAD_START_PULSE_LEN_US,
+    .line_clear_len_us  = RAD_MSG_TYPE_RAD_LINE_CLEAR_LEN_US,
+    .pulses_per_bit     = 2,
+    .symbol_len_us      = {
+        { RAD_MSG_TYPE_RAD_0_PULSE_LEN_US, RAD_MSG_TYPE_RAD_ACTIVE_PULSE_LEN_US },
+        { RAD_MSG_TYPE_RAD_1_PULSE_LEN_US, RAD_MSG_TYPE_RAD_ACTIVE_PULSE_LEN_US },
+    },
+    .len_bits           = RAD_MSG_TYPE_RAD_LEN_IR_BITS,
+    .num_fields         = FIELD_COUNT,
+    .fields             = m_fields,
+#if CONFIG_RAD_RX
+    .start_window       = RAD_RX_START_WINDOW(RAD_MSG_TYPE_RAD_START_PULSE_LEN_US),
+    .symbol_window      = {
+        {
+            RAD_RX_BIT_WINDOW(RAD_MSG_TYPE_RAD_0_PULSE_LEN_US),
+            RAD_RX_BIT_WINDOW(RAD_MSG_TYPE_RAD_ACTIVE_PULSE_LEN_US),
+        },
+        {
+            RAD_RX_BIT_WINDOW(RAD_MSG_TYPE_RAD_1_PULSE_LEN_US),
+            RAD_RX_BIT_WINDOW(RAD_MSG_TYPE_RAD_ACTIVE_PULSE_LEN_US),
+        },
+    },
+#endif
+    .unpack             = unpack,
+    .pack               = pack,
+};
 
 #endif /* CONFIG_RAD_MSG_TYPE_RAD */
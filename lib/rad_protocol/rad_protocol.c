@@ -0,0 +1,428 @@
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+#include <zephyr.h>
+#include <sys/util.h>
+#include <logging/log.h>
+
+#include <rad_protocol.h>
+
+LOG_MODULE_REGISTER(rad_protocol, CONFIG_RAD_PROTOCOL_LOG_LEVEL);
+
+#define SYMBOLS_ALL (BIT(0) | BIT(1))
+
+#if CONFIG_RAD_RX
+#include <drivers/rad_rx.h>
+
+static inline rad_parse_state_t reject(rad_parser_t *parser, rad_parse_reject_t reason)
+{
+    parser->reject = reason;
+    return RAD_PARSE_STATE_INVALID;
+}
+
+static inline uint32_t window_center(rad_window_t window)
+{
+    return ((window.min + window.max) / 2);
+}
+
+static inline uint32_t distance(uint32_t a, uint32_t b)
+{
+    return ((a > b) ? (a - b) : (b - a));
+}
+
+#if CONFIG_RAD_RX_DRIFT_COMPENSATION
+/**
+ * Cheap blasters run from loose oscillators so all of their pulses tend to be too long or too
+ * short by the same factor. That factor is estimated from the start pulse and refined with
+ * every bit of a fixed field (e.g. a preamble) since those are known in advance. Bit pulses are
+ * then scaled back to the nominal time base before they are checked against the windows.
+ */
+#define SCALE_ONE BIT(16)
+
+static inline uint32_t scale_apply(const rad_parser_t *parser, uint32_t pulse)
+{
+    return (uint32_t)(((uint64_t)pulse * parser->scale) >> 16);
+}
+
+static void scale_update(rad_parser_t *parser, uint32_t nominal, uint32_t measured)
+{
+    parser->nominal  += nominal;
+    parser->measured += measured;
+    if (parser->measured) {
+        parser->scale = (uint32_t)(((uint64_t)parser->nominal << 16) / parser->measured);
+    }
+}
+#endif /* CONFIG_RAD_RX_DRIFT_COMPENSATION */
+
+#if CONFIG_RAD_RX_SOFT_DECISION
+/**
+ * Instead of requiring a pulse to be inside a symbol's window, the pulse is given to the
+ * nearest symbol that the bit can still be, as long as it's no further from it than twice
+ * the margin. How close the pulse was is kept as a reliability from 0 to 255: a pulse that's
+ * halfway to the other symbol (or at the edge of the tolerance) was a guess. A bit is as
+ * reliable as its least reliable pulse.
+ */
+#define RELIABILITY_MAX UINT8_MAX
+
+static uint8_t symbols_soft(const struct rad_protocol *protocol, rad_parser_t *parser, uint32_t pulse)
+{
+    const rad_window_t *window0   = &protocol->symbol_window[0][parser->pulse];
+    const rad_window_t *window1   = &protocol->symbol_window[1][parser->pulse];
+    uint32_t            nominal0  = window_center(*window0);
+    uint32_t            nominal1  = window_center(*window1);
+    uint32_t            tolerance = (window0->max - window0->min);
+    uint32_t            limit     = tolerance;
+    uint32_t            d0        = distance(pulse, nominal0);
+    uint32_t            d1        = distance(pulse, nominal1);
+    uint32_t            d;
+    uint8_t             symbols   = parser->symbols;
+
+    if ((SYMBOLS_ALL == symbols) && (nominal0 != nominal1)) {
+        limit   = MIN(limit, (distance(nominal0, nominal1) / 2));
+        symbols = ((d0 == d1) ? SYMBOLS_ALL : ((d0 < d1) ? BIT(0) : BIT(1)));
+    }
+    d = ((symbols & BIT(0)) ? d0 : d1);
+
+    if (tolerance < d) {
+        parser->bit_reliability = 0;
+        return 0;
+    }
+
+    if (d < limit) {
+        parser->bit_reliability = MIN(parser->bit_reliability,
+                                      (((limit - d) * RELIABILITY_MAX) / limit));
+    } else {
+        parser->bit_reliability = 0;
+    }
+    return symbols;
+}
+#endif /* CONFIG_RAD_RX_SOFT_DECISION */
+
+#if CONFIG_RAD_RX_REPAIR
+/**
+ * A protocol with RAD_PROTOCOL_FLAG_REPAIR isn't rejected when a field check or unpack fails.
+ * Instead, the bits that were closest to the threshold between the two symbols are kept and,
+ * once the frame is complete, flipping one and then two of them is tried in order of how
+ * marginal they were. The field checks and unpack (i.e. the checksum) decide whether a
+ * candidate is right.
+ */
+static void margin_update(const struct rad_protocol *protocol, rad_parser_t *parser, uint32_t pulse)
+{
+    uint32_t nominal0 = window_center(protocol->symbol_window[0][parser->pulse]);
+    uint32_t nominal1 = window_center(protocol->symbol_window[1][parser->pulse]);
+
+    if (nominal0 != nominal1) {
+        parser->bit_margin = MIN(parser->bit_margin, distance(pulse, ((nominal0 + nominal1) / 2)));
+    }
+}
+
+static void weak_bit_add(rad_parser_t *parser, uint8_t field, uint8_t bit)
+{
+    int i = parser->num_weak;
+
+    if (RAD_PROTOCOL_MAX_WEAK_BITS == i) {
+        if (parser->weak[i - 1].margin <= parser->bit_margin) {
+            return;
+        }
+        i--;
+    } else {
+        parser->num_weak++;
+    }
+
+    /* Keep the list sorted, most marginal first. */
+    for (; (0 < i) && (parser->bit_margin < parser->weak[i - 1].margin); i--) {
+        parser->weak[i] = parser->weak[i - 1];
+    }
+    parser->weak[i].field  = field;
+    parser->weak[i].bit    = bit;
+    parser->weak[i].margin = parser->bit_margin;
+}
+
+static bool repair_try(const struct rad_protocol *protocol,
+                       rad_parser_t *parser,
+                       uint32_t flips,
+                       void *msg)
+{
+    uint32_t fields[RAD_PROTOCOL_MAX_FIELDS];
+
+    memcpy(fields, parser->fields, sizeof(fields));
+    for (int i=0; i < parser->num_weak; i++) {
+        if (flips & BIT(i)) {
+            fields[parser->weak[i].field] ^= BIT(parser->weak[i].bit);
+        }
+    }
+
+    for (int i=0; i < protocol->num_fields; i++) {
+        const rad_field_t *field = &protocol->fields[i];
+
+        if ((NULL != field->is_valid) && !field->is_valid(fields[i])) {
+            return false;
+        }
+    }
+
+    if (!protocol->unpack(fields, msg)) {
+        return false;
+    }
+
+    parser->repaired = __builtin_popcount(flips);
+    LOG_DBG("Repaired %u bit(s) of a message type %d frame", parser->repaired, protocol->msg_type);
+    return true;
+}
+
+static rad_parse_state_t repair(const struct rad_protocol *protocol, rad_parser_t *parser, void *msg)
+{
+    for (int i=0; i < parser->num_weak; i++) {
+        if (repair_try(protocol, parser, BIT(i), msg)) {
+            return RAD_PARSE_STATE_VALID;
+        }
+    }
+
+    for (int i=0; i < parser->num_weak; i++) {
+        for (int j=(i + 1); j < parser->num_weak; j++) {
+            if (repair_try(protocol, parser, (BIT(i) | BIT(j)), msg)) {
+                return RAD_PARSE_STATE_VALID;
+            }
+        }
+    }
+    return reject(parser, RAD_PARSE_REJECT_CHECK);
+}
+#endif /* CONFIG_RAD_RX_REPAIR */
+
+static inline bool damage_tolerate(const struct rad_protocol *protocol, rad_parser_t *parser)
+{
+#if CONFIG_RAD_RX_REPAIR
+    if (protocol->flags & RAD_PROTOCOL_FLAG_REPAIR) {
+        parser->damaged = true;
+        return true;
+    }
+#endif
+    return false;
+}
+
+static inline bool frame_damaged(const rad_parser_t *parser)
+{
+#if CONFIG_RAD_RX_REPAIR
+    return parser->damaged;
+#else
+    return false;
+#endif
+}
+
+static inline uint32_t expected_bit(const rad_field_t *field, uint32_t field_bits, uint8_t flags)
+{
+    if (flags & RAD_PROTOCOL_FLAG_LSB_FIRST) {
+        return ((field->value >> field_bits) & 1);
+    }
+    return ((field->value >> (field->width - 1 - field_bits)) & 1);
+}
+
+rad_parse_state_t rad_protocol_parse_pulse(const struct rad_protocol *protocol,
+                                             rad_parser_t *parser,
+                                             uint32_t pulse,
+                                             void *msg)
+{
+    const rad_field_t *field;
+    uint32_t           bit;
+    uint8_t            symbols;
+
+    if (0 == parser->index++) {
+        if (!RAD_RX_IN_WINDOW(pulse, protocol->start_window)) {
+            return reject(parser, RAD_PARSE_REJECT_START);
+        }
+        parser->pulse      = 0;
+        parser->symbols    = SYMBOLS_ALL;
+        parser->field      = 0;
+        parser->field_bits = 0;
+        parser->fields[0]  = 0;
+#if CONFIG_RAD_RX_REPAIR
+        parser->bit_margin = UINT32_MAX;
+        parser->num_weak   = 0;
+        parser->damaged    = false;
+        parser->repaired   = 0;
+#endif
+#if CONFIG_RAD_RX_SOFT_DECISION
+        parser->bit_reliability = RELIABILITY_MAX;
+        parser->reliability     = 0;
+#endif
+#if CONFIG_RAD_RX_DRIFT_COMPENSATION
+        parser->bit_len    = 0;
+        parser->nominal    = 0;
+        parser->measured   = 0;
+        parser->scale      = SCALE_ONE;
+        scale_update(parser, window_center(protocol->start_window), pulse);
+#endif
+        return RAD_PARSE_STATE_INCOMPLETE;
+    }
+
+    if (protocol->num_fields <= parser->field) {
+        /* The message is already complete so this pulse makes it too long. */
+        return reject(parser, RAD_PARSE_REJECT_LENGTH);
+    }
+
+#if CONFIG_RAD_RX_DRIFT_COMPENSATION
+    parser->bit_len += pulse;
+    pulse            = scale_apply(parser, pulse);
+#endif
+
+    /* Narrow down the symbols that the current bit can be. */
+#if CONFIG_RAD_RX_SOFT_DECISION
+    symbols = symbols_soft(protocol, parser, pulse);
+#else
+    symbols = parser->symbols;
+    if (!RAD_RX_IN_WINDOW(pulse, protocol->symbol_window[0][parser->pulse])) {
+        symbols &= ~BIT(0);
+    }
+    if (!RAD_RX_IN_WINDOW(pulse, protocol->symbol_window[1][parser->pulse])) {
+        symbols &= ~BIT(1);
+    }
+#endif
+
+#if CONFIG_RAD_RX_REPAIR
+    if (protocol->flags & RAD_PROTOCOL_FLAG_REPAIR) {
+        margin_update(protocol, parser, pulse);
+    }
+#endif
+
+    if (++parser->pulse < protocol->pulses_per_bit) {
+        if (0 == symbols) {
+            return reject(parser, RAD_PARSE_REJECT_SYMBOL);
+        }
+        parser->symbols = symbols;
+        return RAD_PARSE_STATE_INCOMPLETE;
+    }
+    parser->pulse   = 0;
+    parser->symbols = SYMBOLS_ALL;
+
+    if (BIT(1) == symbols) {
+        bit = 1;
+    } else if ((BIT(0) == symbols) || (protocol->flags & RAD_PROTOCOL_FLAG_DEFAULT_0)) {
+        bit = 0;
+    } else {
+        return reject(parser, RAD_PARSE_REJECT_SYMBOL);
+    }
+
+    field = &protocol->fields[parser->field];
+    if (field->fixed && (bit != expected_bit(field, parser->field_bits, protocol->flags))) {
+        return reject(parser, RAD_PARSE_REJECT_FIELD);
+    }
+
+#if CONFIG_RAD_RX_SOFT_DECISION
+    parser->reliability    += parser->bit_reliability;
+    parser->bit_reliability = RELIABILITY_MAX;
+#endif
+
+#if CONFIG_RAD_RX_DRIFT_COMPENSATION
+    if (field->fixed) {
+        uint32_t nominal = 0;
+
+        for (int i=0; i < protocol->pulses_per_bit; i++) {
+            nominal += window_center(protocol->symbol_window[bit][i]);
+        }
+        scale_update(parser, nominal, parser->bit_len);
+    }
+    parser->bit_len = 0;
+#endif
+
+#if CONFIG_RAD_RX_REPAIR
+    if ((protocol->flags & RAD_PROTOCOL_FLAG_REPAIR) && !field->fixed) {
+        /* Position of the bit once the whole field has been received. */
+        weak_bit_add(parser, parser->field,
+                     ((protocol->flags & RAD_PROTOCOL_FLAG_LSB_FIRST) ?
+                         parser->field_bits : (field->width - 1 - parser->field_bits)));
+    }
+    parser->bit_margin = UINT32_MAX;
+#endif
+
+    if (protocol->flags & RAD_PROTOCOL_FLAG_LSB_FIRST) {
+        parser->fields[parser->field] |= (bit << parser->field_bits);
+    } else {
+        parser->fields[parser->field] = ((parser->fields[parser->field] << 1) | bit);
+    }
+
+    if (++parser->field_bits < field->width) {
+        return RAD_PARSE_STATE_INCOMPLETE;
+    }
+
+    if ((NULL != field->is_valid) && !field->is_valid(parser->fields[parser->field])) {
+        if (!damage_tolerate(protocol, parser)) {
+            return reject(parser, RAD_PARSE_REJECT_FIELD);
+        }
+    }
+
+    parser->field_bits = 0;
+    if (++parser->field < protocol->num_fields) {
+        parser->fields[parser->field] = 0;
+        return RAD_PARSE_STATE_INCOMPLETE;
+    }
+
+    if (!frame_damaged(parser) && protocol->unpack(parser->fields, msg)) {
+        return RAD_PARSE_STATE_VALID;
+    }
+
+#if CONFIG_RAD_RX_REPAIR
+    if (protocol->flags & RAD_PROTOCOL_FLAG_REPAIR) {
+        return repair(protocol, parser, msg);
+    }
+#endif
+    return reject(parser, RAD_PARSE_REJECT_CHECK);
+}
+#endif /* CONFIG_RAD_RX */
+
+#if CONFIG_RAD_TX
+#include <drivers/rad_tx.h>
+
+static inline rad_run_t *run(rad_run_t *p_runs, bool active, uint32_t len_us)
+{
+    *p_runs = RAD_RUN(active, (len_us / RAD_TX_PWM_VALUE_LEN_US));
+    return (p_runs + 1);
+}
+
+int rad_protocol_encode(const struct rad_protocol *protocol,
+                          const void *msg,
+                          rad_run_t *runs,
+                          uint32_t *len)
+{
+    rad_run_t *p_runs = runs;
+    uint32_t   fields[RAD_PROTOCOL_MAX_FIELDS];
+    bool       active = false;
+
+    if (*len < (1 + (protocol->len_bits * protocol->pulses_per_bit) + 1)) {
+        return -ENOMEM;
+    }
+
+    int err = protocol->pack(msg, fields);
+    if (err) {
+        return err;
+    }
+
+    p_runs = run(p_runs, true, protocol->start_pulse_len_us);
+
+    for (int i=0; i < protocol->num_fields; i++) {
+        const rad_field_t *field = &protocol->fields[i];
+        uint32_t           value = (field->fixed ? field->value : fields[i]);
+
+        for (int j=0; j < field->width; j++) {
+            uint32_t bit;
+
+            if (protocol->flags & RAD_PROTOCOL_FLAG_LSB_FIRST) {
+                bit = ((value >> j) & 1);
+            } else {
+                bit = ((value >> (field->width - 1 - j)) & 1);
+            }
+
+            for (int k=0; k < protocol->pulses_per_bit; k++) {
+                p_runs = run(p_runs, active, protocol->symbol_len_us[bit][k]);
+                active = !active;
+            }
+        }
+    }
+
+    /* A single inactive value ends the last pulse. */
+    *p_runs++ = RAD_RUN(false, 1);
+
+    *len = (p_runs - runs);
+    return 0;
+}
+#endif /* CONFIG_RAD_TX */
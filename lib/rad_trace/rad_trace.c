@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <kernel.h>
+
+#include <rad_trace.h>
+
+#if CONFIG_TRACING_CTF
+#include <ctf_top.h>
+
+/**
+ * Event ids of the tracepoints in the CTF stream. They're well above the ids of the kernel's
+ * own events. Append the 'metadata' file of this directory to the kernel's CTF metadata so
+ * that Trace Compass or babeltrace can decode them.
+ */
+enum {
+    RAD_TRACE_CTF_RX_EDGE = 0xD0,
+    RAD_TRACE_CTF_RX_WORK_SUBMIT,
+    RAD_TRACE_CTF_RX_DECODE_ENTER,
+    RAD_TRACE_CTF_RX_DECODE_EXIT,
+    RAD_TRACE_CTF_RX_PARSE,
+    RAD_TRACE_CTF_RX_CALLBACK,
+    RAD_TRACE_CTF_TX_START,
+    RAD_TRACE_CTF_TX_STOPPED,
+};
+
+#define RAD_TRACE_EVENT(id, ...) CTF_EVENT(CTF_LITERAL(uint8_t, (id)), __VA_ARGS__)
+#else
+#define RAD_TRACE_EVENT(id, ...)
+#endif /* CONFIG_TRACING_CTF */
+
+void __weak sys_trace_rad_rx_edge(uint8_t dev_id)
+{
+    RAD_TRACE_EVENT(RAD_TRACE_CTF_RX_EDGE, dev_id);
+}
+
+void __weak sys_trace_rad_rx_work_submit(uint8_t dev_id)
+{
+    RAD_TRACE_EVENT(RAD_TRACE_CTF_RX_WORK_SUBMIT, dev_id);
+}
+
+void __weak sys_trace_rad_rx_decode_enter(uint8_t dev_id)
+{
+    RAD_TRACE_EVENT(RAD_TRACE_CTF_RX_DECODE_ENTER, dev_id);
+}
+
+void __weak sys_trace_rad_rx_decode_exit(uint8_t dev_id)
+{
+    RAD_TRACE_EVENT(RAD_TRACE_CTF_RX_DECODE_EXIT, dev_id);
+}
+
+void __weak sys_trace_rad_rx_parse(uint8_t dev_id, uint8_t msg_type, uint8_t state)
+{
+    RAD_TRACE_EVENT(RAD_TRACE_CTF_RX_PARSE, dev_id, msg_type, state);
+}
+
+void __weak sys_trace_rad_rx_callback(uint8_t dev_id, uint8_t msg_type)
+{
+    RAD_TRACE_EVENT(RAD_TRACE_CTF_RX_CALLBACK, dev_id, msg_type);
+}
+
+void __weak sys_trace_rad_tx_start(uint8_t dev_id, uint8_t msg_type)
+{
+    RAD_TRACE_EVENT(RAD_TRACE_CTF_TX_START, dev_id, msg_type);
+}
+
+void __weak sys_trace_rad_tx_stopped(uint8_t dev_id, uint8_t msg_type)
+{
+    RAD_TRACE_EVENT(RAD_TRACE_CTF_TX_STOPPED, dev_id, msg_type);
+}
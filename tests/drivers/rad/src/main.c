@@ -2,9 +2,13 @@
 
 #include <drivers/rad_rx.h>
 #include <drivers/rad_tx.h>
+#if CONFIG_PM_DEVICE
+#include <pm/device.h>
+#endif
 
 #define LOOPBACK_LATENCY_MS 50
 #define LINE_CLEAR_DELAY_MS 1
+#define RX_ASLEEP_DELAY_MS  10 /* Long enough for a receiver to fall asleep with WAKE_ON_LEVEL. */
 
 const static struct device *rx_dev;
 const static struct device *tx_dev;
@@ -14,6 +18,10 @@ static void *cur_data;
 
 static K_SEM_DEFINE(loopback, 0, 1);
 
+static atomic_t received;
+static atomic_t tx_done;
+static atomic_t tx_canceled;
+
 void rad_rx_cb(rad_msg_type_t msg_type, void *data)
 {
 	zassert_equal(msg_type, cur_msg_type,
@@ -38,9 +46,23 @@ void rad_rx_cb(rad_msg_type_t msg_type, void *data)
 		zassert_unreachable("Unknown rad_msg_type_t received: %d", msg_type);
 		break;
 	}
+	atomic_inc(&received);
 	k_sem_give(&loopback);
 }
 
+#if CONFIG_RAD_TX_ASYNC
+void rad_tx_cb(const struct device *dev, rad_msg_type_t msg_type, int result)
+{
+	if (-ECANCELED == result) {
+		/* Preempted by a more urgent blast. */
+		atomic_inc(&tx_canceled);
+		return;
+	}
+	zassert_equal(result, 0, "Queued blast failed: %d", result);
+	atomic_inc(&tx_done);
+}
+#endif
+
 static void blast_and_wait(rad_msg_type_t msg_type, void *data)
 {
 	int ret;
@@ -153,13 +175,239 @@ static void test_rad_loopback(void)
     }
 }
 
+static void test_async_loopback(void)
+{
+#if CONFIG_RAD_TX_ASYNC
+	rad_msg_t            msg = { .laser_x = { .team_id = TEAM_ID_LASER_X_BLUE } };
+	struct k_poll_signal signals[3];
+	struct k_poll_event  events[ARRAY_SIZE(signals)];
+	unsigned int         signaled;
+	int                  result;
+	int                  ret;
+
+	ret = rad_tx_set_callback(tx_dev, rad_tx_cb);
+	zassert_equal(ret, 0, "Failed to set Rad TX callback");
+
+	cur_msg_type = RAD_MSG_TYPE_LASER_X;
+	cur_data     = &msg.laser_x;
+	atomic_clear(&received);
+	atomic_clear(&tx_done);
+
+	/* Every call returns right away and the blasts follow each other. */
+	for (int i=0; i < ARRAY_SIZE(signals); i++) {
+		k_poll_signal_init(&signals[i]);
+		k_poll_event_init(&events[i], K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &signals[i]);
+
+		ret = rad_tx_blast_async(tx_dev, RAD_MSG_TYPE_LASER_X, &msg, &signals[i]);
+		zassert_equal(ret, 0, "rad_tx_blast_async failed: %d", ret);
+	}
+	zassert_equal(atomic_get(&tx_done), 0, "Blast ended before it was sent.");
+
+	ret = k_poll(&events[ARRAY_SIZE(events) - 1], 1, K_MSEC(ARRAY_SIZE(signals) * LOOPBACK_LATENCY_MS));
+	zassert_equal(ret, 0, "rad_tx_blast_async timed out.");
+
+	for (int i=0; i < ARRAY_SIZE(signals); i++) {
+		k_poll_signal_check(&signals[i], &signaled, &result);
+		zassert_true(signaled, "Blast %d wasn't signaled.", i);
+		zassert_equal(result, 0, "Blast %d failed: %d", i, result);
+	}
+	zassert_equal(atomic_get(&tx_done), ARRAY_SIZE(signals), "Unexpected number of callbacks.");
+
+	k_msleep(LOOPBACK_LATENCY_MS);
+	zassert_equal(atomic_get(&received), ARRAY_SIZE(signals), "Queued blasts weren't received apart.");
+	k_sem_reset(&loopback);
+
+	/* A blast queued behind a blocking one still gets the gap, or both frames merge. */
+	k_msleep(LINE_CLEAR_DELAY_MS);
+	atomic_clear(&received);
+	k_poll_signal_reset(&signals[0]);
+	events[0].state = K_POLL_STATE_NOT_READY;
+
+	ret = rad_tx_laser_x_blast(tx_dev, &msg.laser_x);
+	zassert_equal(ret, 0, "rad_tx_laser_x_blast failed: %d", ret);
+
+	ret = rad_tx_blast_async(tx_dev, RAD_MSG_TYPE_LASER_X, &msg, &signals[0]);
+	zassert_equal(ret, 0, "rad_tx_blast_async failed: %d", ret);
+
+	ret = k_poll(&events[0], 1, K_MSEC(2 * LOOPBACK_LATENCY_MS));
+	zassert_equal(ret, 0, "rad_tx_blast_async timed out.");
+	k_poll_signal_check(&signals[0], &signaled, &result);
+	zassert_equal(result, 0, "Blast queued behind a blocking blast failed: %d", result);
+
+	k_msleep(LOOPBACK_LATENCY_MS);
+	zassert_equal(atomic_get(&received), 2, "Blast queued behind a blocking blast wasn't received apart.");
+	k_sem_reset(&loopback);
+
+	/* Invalid messages are rejected right away. */
+	msg.laser_x.team_id = 0xFF;
+	ret = rad_tx_blast_async(tx_dev, RAD_MSG_TYPE_LASER_X, &msg, NULL);
+	zassert_equal(ret, -EINVAL, "Invalid message was queued: %d", ret);
+#else
+	ztest_test_skip();
+#endif
+}
+
+static void test_priority_loopback(void)
+{
+#if CONFIG_RAD_TX_PREEMPT
+	/* Dynasty frames last over 25 ms so the urgent blast is queued while the first one plays. */
+	rad_msg_t            low  = { .dynasty = { .team_id = TEAM_ID_DYNASTY_RED,
+	                                           .weapon_id = WEAPON_ID_DYNASTY_ROCKET } };
+	rad_msg_t            high = { .rad = { .damage = 3, .player_id = 5, .version = RAD_MSG_VERSION } };
+	struct k_poll_signal signals[2];
+	struct k_poll_event  event;
+	unsigned int         signaled;
+	int                  result;
+	int                  ret;
+
+	ret = rad_tx_set_callback(tx_dev, rad_tx_cb);
+	zassert_equal(ret, 0, "Failed to set Rad TX callback");
+
+	for (int requeue=0; requeue < 2; requeue++) {
+		k_sem_reset(&loopback);
+		atomic_clear(&received);
+		atomic_clear(&tx_canceled);
+		cur_msg_type = RAD_MSG_TYPE_RAD;
+		cur_data     = &high.rad;
+
+		for (int i=0; i < ARRAY_SIZE(signals); i++) {
+			k_poll_signal_init(&signals[i]);
+		}
+		k_poll_event_init(&event, K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &signals[0]);
+
+		ret = rad_tx_blast_priority(tx_dev, RAD_MSG_TYPE_DYNASTY, &low, 0,
+		                            (requeue ? RAD_TX_FLAG_REQUEUE : 0), &signals[0]);
+		zassert_equal(ret, 0, "rad_tx_blast_priority failed: %d", ret);
+		ret = rad_tx_blast_priority(tx_dev, RAD_MSG_TYPE_RAD, &high, 1, 0, &signals[1]);
+		zassert_equal(ret, 0, "rad_tx_blast_priority failed: %d", ret);
+
+		/* The urgent blast goes first and the partial frame is dropped by the receiver. */
+		ret = k_sem_take(&loopback, K_MSEC(LOOPBACK_LATENCY_MS));
+		zassert_equal(ret, 0, "Urgent blast wasn't received.");
+		k_poll_signal_check(&signals[1], &signaled, &result);
+		zassert_true(signaled, "Urgent blast wasn't signaled.");
+		zassert_equal(result, 0, "Urgent blast failed: %d", result);
+
+		if (requeue) {
+			/* Played again in full once the urgent blast has ended. */
+			cur_msg_type = RAD_MSG_TYPE_DYNASTY;
+			cur_data     = &low.dynasty;
+
+			ret = k_sem_take(&loopback, K_MSEC(LOOPBACK_LATENCY_MS));
+			zassert_equal(ret, 0, "Preempted blast wasn't sent again.");
+		}
+
+		ret = k_poll(&event, 1, K_MSEC(LOOPBACK_LATENCY_MS));
+		zassert_equal(ret, 0, "Preempted blast wasn't signaled.");
+		k_poll_signal_check(&signals[0], &signaled, &result);
+		zassert_equal(result, (requeue ? 0 : -ECANCELED), "Unexpected result: %d", result);
+		zassert_equal(atomic_get(&tx_canceled), (requeue ? 0 : 1), "Unexpected cancellations.");
+
+		k_msleep(LOOPBACK_LATENCY_MS);
+		zassert_equal(atomic_get(&received), (1 + requeue), "Unexpected number of messages.");
+	}
+	k_sem_reset(&loopback);
+#else
+	ztest_test_skip();
+#endif
+}
+
+static void test_slot_loopback(void)
+{
+#if CONFIG_RAD_TX_SLOTS
+	rad_msg_t msgs[] = {
+		{ .laser_x = { .team_id = TEAM_ID_LASER_X_RED } },
+		{ .dynasty = { .team_id = TEAM_ID_DYNASTY_BLUE, .weapon_id = WEAPON_ID_DYNASTY_PISTOL } },
+	};
+	rad_msg_type_t msg_types[] = { RAD_MSG_TYPE_LASER_X, RAD_MSG_TYPE_DYNASTY };
+	int            ret;
+
+	BUILD_ASSERT(ARRAY_SIZE(msgs) <= CONFIG_RAD_TX_SLOTS, "Not enough slots");
+
+	ret = rad_tx_slot_blast(tx_dev, 0);
+	zassert_equal(ret, -ENOENT, "Empty slot was blasted: %d", ret);
+	ret = rad_tx_slot_blast(tx_dev, CONFIG_RAD_TX_SLOTS);
+	zassert_equal(ret, -EINVAL, "Missing slot was blasted: %d", ret);
+
+	for (int i=0; i < ARRAY_SIZE(msgs); i++) {
+		ret = rad_tx_slot_set(tx_dev, i, msg_types[i], &msgs[i]);
+		zassert_equal(ret, 0, "rad_tx_slot_set failed: %d", ret);
+	}
+
+	/* Every slot keeps its own waveform, and blast_again repeats the last slot. */
+	for (int n=0; n < 2; n++) {
+		for (int i=0; i < ARRAY_SIZE(msgs); i++) {
+			cur_msg_type = msg_types[i];
+			cur_data     = &msgs[i];
+
+			ret = rad_tx_slot_blast(tx_dev, i);
+			zassert_equal(ret, 0, "rad_tx_slot_blast failed: %d", ret);
+			ret = k_sem_take(&loopback, K_MSEC(LOOPBACK_LATENCY_MS));
+			zassert_equal(ret, 0, "rad_tx_slot_blast loopback timed out.");
+			k_msleep(LINE_CLEAR_DELAY_MS);
+
+			ret = rad_tx_blast_again(tx_dev);
+			zassert_equal(ret, 0, "rad_tx_blast_again failed: %d", ret);
+			ret = k_sem_take(&loopback, K_MSEC(LOOPBACK_LATENCY_MS));
+			zassert_equal(ret, 0, "rad_tx_blast_again loopback timed out.");
+			k_msleep(LINE_CLEAR_DELAY_MS);
+		}
+	}
+
+	msgs[0].laser_x.team_id = 0xFF;
+	ret = rad_tx_slot_set(tx_dev, 0, RAD_MSG_TYPE_LASER_X, &msgs[0]);
+	zassert_not_equal(ret, 0, "Invalid message was encoded.");
+	ret = rad_tx_slot_blast(tx_dev, 0);
+	zassert_equal(ret, -ENOENT, "Slot of an invalid message was blasted: %d", ret);
+#else
+	ztest_test_skip();
+#endif
+}
+
+#if CONFIG_PM_DEVICE
+static void pm_cycle(void)
+{
+	int ret;
+
+	ret = pm_device_action_run(rx_dev, PM_DEVICE_ACTION_SUSPEND);
+	zassert_equal(ret, 0, "Suspend failed: %d", ret);
+
+	ret = pm_device_action_run(rx_dev, PM_DEVICE_ACTION_RESUME);
+	zassert_equal(ret, 0, "Resume failed: %d", ret);
+}
+#endif
+
+static void test_pm_loopback(void)
+{
+#if CONFIG_PM_DEVICE
+	rad_msg_laser_x_t msg = { .team_id = TEAM_ID_LASER_X_RED };
+
+	/* Suspended once while the receiver is timing edges, right after a frame... */
+	blast_and_wait(RAD_MSG_TYPE_LASER_X, &msg);
+	pm_cycle();
+
+	/* ...and once while it is asleep. Edges must still be timed afterwards. */
+	k_msleep(RX_ASLEEP_DELAY_MS);
+	pm_cycle();
+
+	k_msleep(RX_ASLEEP_DELAY_MS);
+	blast_and_wait(RAD_MSG_TYPE_LASER_X, &msg);
+#else
+	ztest_test_skip();
+#endif
+}
+
 void test_main(void)
 {
 	ztest_test_suite(test_rad,
 		ztest_unit_test(test_get_binding),
     	ztest_unit_test(test_laser_x_loopback),
     	ztest_unit_test(test_dynasty_loopback),
-    	ztest_unit_test(test_rad_loopback)
+    	ztest_unit_test(test_rad_loopback),
+    	ztest_unit_test(test_async_loopback),
+    	ztest_unit_test(test_priority_loopback),
+    	ztest_unit_test(test_slot_loopback),
+    	ztest_unit_test(test_pm_loopback)
 	);
 
 	ztest_run_test_suite(test_rad);
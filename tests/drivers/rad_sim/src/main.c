@@ -0,0 +1,876 @@
+#include <ztest.h>
+
+#include <drivers/rad_rx.h>
+#include <drivers/rad_rx_group.h>
+#if CONFIG_RAD_MSG_TYPE_LEARNED
+#include <rad_learn.h>
+#endif
+#if CONFIG_PM_DEVICE
+#include <pm/device.h>
+#endif
+
+#define DECODE_LATENCY_MS 10
+#define GROUP_WINDOW_MS   20 /* Must match the overlay. */
+#define RX1_SENSOR_ID     7  /* Must match the overlay. */
+
+const static struct device *rx_dev;
+const static struct device *rx1_dev;
+const static struct device *group_dev;
+
+static rad_msg_type_t rx_msg_type;
+static rad_msg_t      rx_msg;
+
+static K_SEM_DEFINE(received, 0, 4);
+
+static uint32_t group_sensors;
+
+static K_SEM_DEFINE(group_received, 0, 4);
+
+void rad_rx_cb(rad_msg_type_t msg_type, void *data)
+{
+	rx_msg_type = msg_type;
+	memcpy(&rx_msg, data, sizeof(rx_msg));
+	k_sem_give(&received);
+}
+
+void rad_rx_group_cb(rad_msg_type_t msg_type, void *data, uint32_t sensors)
+{
+	rx_msg_type   = msg_type;
+	group_sensors = sensors;
+	memcpy(&rx_msg, data, sizeof(rx_msg));
+	k_sem_give(&group_received);
+}
+
+/* Generates the pulses of a frame the same way rad_protocol_encode does, but in microseconds. */
+static size_t frame_build(const struct rad_protocol *protocol, const void *msg, uint32_t *pulses)
+{
+	uint32_t fields[RAD_PROTOCOL_MAX_FIELDS];
+	size_t   len = 0;
+	int      ret;
+
+	ret = protocol->pack(msg, fields);
+	zassert_equal(ret, 0, "pack failed: %d", ret);
+
+	pulses[len++] = protocol->start_pulse_len_us;
+
+	for (int i=0; i < protocol->num_fields; i++) {
+		const rad_field_t *field = &protocol->fields[i];
+		uint32_t           value = (field->fixed ? field->value : fields[i]);
+
+		for (int j=0; j < field->width; j++) {
+			uint32_t bit;
+
+			if (protocol->flags & RAD_PROTOCOL_FLAG_LSB_FIRST) {
+				bit = ((value >> j) & 1);
+			} else {
+				bit = ((value >> (field->width - 1 - j)) & 1);
+			}
+
+			for (int k=0; k < protocol->pulses_per_bit; k++) {
+				pulses[len++] = protocol->symbol_len_us[bit][k];
+			}
+		}
+	}
+
+	zassert_equal(len, RAD_PROTOCOL_LEN_PULSES(protocol), "Unexpected frame length");
+	return len;
+}
+
+static void pulses_feed_and_wait(const struct rad_protocol *protocol, const uint32_t *pulses, size_t len)
+{
+	int ret;
+
+	ret = rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses, len);
+	zassert_equal(ret, 0, "rad_rx_sim_feed failed: %d", ret);
+
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_equal(ret, 0, "Message wasn't received.");
+	zassert_equal(rx_msg_type, protocol->msg_type,
+		            "Unexpected rad_msg_type_t received: %d != %d", rx_msg_type, protocol->msg_type);
+}
+
+static void feed_and_wait(const struct rad_protocol *protocol, const void *msg, int32_t jitter_us)
+{
+	uint32_t pulses[RAD_RX_MSG_MAX_LEN];
+	size_t   len = frame_build(protocol, msg, pulses);
+
+	/* Alternately stretch and shrink the bit pulses. */
+	for (size_t i=1; i < len; i++) {
+		pulses[i] += ((i % 2) ? jitter_us : -jitter_us);
+	}
+
+	pulses_feed_and_wait(protocol, pulses, len);
+}
+
+static void test_get_binding(void)
+{
+	int ret;
+
+	rx_dev = device_get_binding("rad_rx0");
+	zassert_not_null(rx_dev, "Failed to get RX dev binding");
+
+	ret = rad_rx_set_callback(rx_dev, rad_rx_cb);
+	zassert_equal(ret, 0, "Failed to set Rad RX callback");
+}
+
+static void test_laser_x_sim(void)
+{
+	rad_msg_laser_x_t msg;
+
+	for (int i=TEAM_ID_LASER_X_BLUE; i <= TEAM_ID_LASER_X_NEUTRAL; i++) {
+		msg.team_id = i;
+		feed_and_wait(&rad_msg_type_laser_x_protocol, &msg, 0);
+		zassert_mem_equal(&rx_msg.laser_x, &msg, sizeof(msg), "Invalid LASER_X message data.");
+	}
+}
+
+static void test_dynasty_sim(void)
+{
+	rad_msg_dynasty_t msg;
+
+	for (int i=TEAM_ID_DYNASTY_BLUE; i <= TEAM_ID_DYNASTY_WHITE; i++) {
+		msg.team_id = i;
+
+		for (int j=WEAPON_ID_DYNASTY_PISTOL; j <= WEAPON_ID_DYNASTY_ROCKET; j++) {
+			msg.weapon_id = j;
+			feed_and_wait(&rad_msg_type_dynasty_protocol, &msg, 0);
+			zassert_equal(rx_msg.dynasty.team_id, msg.team_id, "Invalid DYNASTY team_id.");
+			zassert_equal(rx_msg.dynasty.weapon_id, msg.weapon_id, "Invalid DYNASTY weapon_id.");
+		}
+	}
+}
+
+static void test_rad_sim(void)
+{
+	rad_msg_rad_t msg;
+
+	msg.version = RAD_MSG_VERSION;
+	for (int team_id=0; team_id <= 0x3; team_id++) {
+		msg.team_id   = team_id;
+		msg.player_id = (0xF - team_id);
+		msg.special   = team_id;
+		msg.damage    = (0x5 + team_id);
+		feed_and_wait(&rad_msg_type_rad_protocol, &msg, 0);
+		zassert_mem_equal(&rx_msg.rad, &msg, sizeof(msg), "Invalid RAD message data.");
+	}
+}
+
+static void test_margin_sim(void)
+{
+	rad_msg_laser_x_t laser_x_msg = { .team_id = TEAM_ID_LASER_X_RED };
+	rad_msg_rad_t     rad_msg     = { .version = RAD_MSG_VERSION, .team_id = 2, .damage = 9 };
+
+	feed_and_wait(&rad_msg_type_laser_x_protocol, &laser_x_msg, RAD_RX_BIT_MARGIN_US);
+	feed_and_wait(&rad_msg_type_laser_x_protocol, &laser_x_msg, -RAD_RX_BIT_MARGIN_US);
+	/* Stretching the long space of a Rad 1 by the full margin would make it look like a line clear. */
+	feed_and_wait(&rad_msg_type_rad_protocol, &rad_msg, -RAD_RX_BIT_MARGIN_US);
+}
+
+static void test_soft_sim(void)
+{
+	rad_msg_laser_x_t   msg = { .team_id = TEAM_ID_LASER_X_NEUTRAL };
+	struct rad_rx_event event;
+	int                 ret;
+
+	if (!IS_ENABLED(CONFIG_RAD_RX_SOFT_DECISION)) {
+		ztest_test_skip();
+		return;
+	}
+
+	/* Drop whatever was queued during the other tests. */
+	while (0 == rad_rx_read(rx_dev, &event, K_NO_WAIT)) {
+	}
+
+	feed_and_wait(&rad_msg_type_laser_x_protocol, &msg, 0);
+	ret = rad_rx_read(rx_dev, &event, K_NO_WAIT);
+	zassert_equal(ret, 0, "Event wasn't queued.");
+	zassert_equal(event.confidence, 100, "Unexpected confidence: %u", event.confidence);
+
+	/* Outside of the windows but still nearest to the right symbols. */
+	feed_and_wait(&rad_msg_type_laser_x_protocol, &msg, ((RAD_RX_BIT_MARGIN_US * 3) / 2));
+	zassert_mem_equal(&rx_msg.laser_x, &msg, sizeof(msg), "Invalid LASER_X message data.");
+	ret = rad_rx_read(rx_dev, &event, K_NO_WAIT);
+	zassert_equal(ret, 0, "Event wasn't queued.");
+	zassert_true((event.confidence > 0) && (event.confidence < 100),
+		     "Unexpected confidence: %u", event.confidence);
+}
+
+static void repair_feed_and_wait(const rad_msg_dynasty_t *msg, int num_errors)
+{
+	uint32_t            pulses[RAD_RX_MSG_MAX_LEN];
+	size_t              len = frame_build(&rad_msg_type_dynasty_protocol, msg, pulses);
+	struct rad_rx_event event;
+	int                 ret;
+
+	/* Drop whatever was queued before. */
+	while (0 == rad_rx_read(rx_dev, &event, K_NO_WAIT)) {
+	}
+
+	/* Turn the last ones of the frame into marginal zeros, just short of the threshold. */
+	for (size_t i=(len - 1); (0 < num_errors) && (0 < i); i--) {
+		if (RAD_MSG_TYPE_DYNASTY_1_PULSE_LEN_US == pulses[i]) {
+			pulses[i] = (((RAD_MSG_TYPE_DYNASTY_0_PULSE_LEN_US + RAD_MSG_TYPE_DYNASTY_1_PULSE_LEN_US) / 2) -
+				     (10 * num_errors));
+			num_errors--;
+		}
+	}
+
+	pulses_feed_and_wait(&rad_msg_type_dynasty_protocol, pulses, len);
+	zassert_equal(rx_msg.dynasty.team_id, msg->team_id, "Invalid DYNASTY team_id.");
+	zassert_equal(rx_msg.dynasty.weapon_id, msg->weapon_id, "Invalid DYNASTY weapon_id.");
+
+	ret = rad_rx_read(rx_dev, &event, K_NO_WAIT);
+	zassert_equal(ret, 0, "Event wasn't queued.");
+	zassert_not_equal(event.repaired, 0, "Message wasn't reported as repaired.");
+}
+
+static void test_repair_sim(void)
+{
+	rad_msg_dynasty_t msg = { .team_id = TEAM_ID_DYNASTY_WHITE, .weapon_id = WEAPON_ID_DYNASTY_SHOTGUN_SMG };
+
+	if (!IS_ENABLED(CONFIG_RAD_RX_REPAIR)) {
+		ztest_test_skip();
+		return;
+	}
+
+	repair_feed_and_wait(&msg, 1);
+	repair_feed_and_wait(&msg, 2);
+}
+
+static void collision_expect(enum rad_rx_collision collision)
+{
+	struct rad_rx_event event;
+	int                 ret;
+
+	do {
+		ret = rad_rx_read(rx_dev, &event, K_MSEC(DECODE_LATENCY_MS));
+		zassert_equal(ret, 0, "Collision wasn't reported.");
+	} while (RAD_RX_EVENT_COLLISION != event.type);
+
+	zassert_equal(event.collision, collision, "Unexpected collision: %d", event.collision);
+}
+
+static void test_collision_sim(void)
+{
+	rad_msg_laser_x_t   laser_x_msg = { .team_id = TEAM_ID_LASER_X_BLUE };
+	rad_msg_rad_t       rad_msg     = { .version = RAD_MSG_VERSION, .team_id = 3, .damage = 1 };
+	uint32_t            pulses[2 * RAD_RX_MSG_MAX_LEN];
+	uint32_t            counts[RAD_RX_COLLISION_COUNT];
+	struct rad_rx_event event;
+	size_t              len;
+	int                 ret;
+
+	if (!IS_ENABLED(CONFIG_RAD_RX_COLLISION_DETECT)) {
+		ztest_test_skip();
+		return;
+	}
+
+	while (0 == rad_rx_read(rx_dev, &event, K_NO_WAIT)) {
+	}
+
+	/* A complete message that goes on. */
+	len = frame_build(&rad_msg_type_laser_x_protocol, &laser_x_msg, pulses);
+	pulses[len++] = RAD_MSG_TYPE_LASER_X_SPACE_PULSE_LEN_US;
+	pulses[len++] = RAD_MSG_TYPE_LASER_X_1_PULSE_LEN_US;
+	pulses_feed_and_wait(&rad_msg_type_laser_x_protocol, pulses, len);
+	collision_expect(RAD_RX_COLLISION_LENGTH);
+
+	/* A second frame that starts halfway through the first one. */
+	frame_build(&rad_msg_type_rad_protocol, &rad_msg, pulses);
+	len = (20 + frame_build(&rad_msg_type_rad_protocol, &rad_msg, &pulses[20]));
+	rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses, len);
+	collision_expect(RAD_RX_COLLISION_START);
+
+	/* A fragment of a pulse. */
+	len = frame_build(&rad_msg_type_rad_protocol, &rad_msg, pulses);
+	pulses[12] = 100;
+	rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses, len);
+	collision_expect(RAD_RX_COLLISION_WIDTH);
+
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_not_equal(ret, 0, "A collision was received as a message.");
+
+	ret = rad_rx_collisions_get(rx_dev, counts);
+	zassert_equal(ret, 0, "Failed to get collision counts: %d", ret);
+	for (int i=0; i < RAD_RX_COLLISION_COUNT; i++) {
+		zassert_not_equal(counts[i], 0, "Collision %d wasn't counted.", i);
+	}
+}
+
+static void drift_feed_and_wait(const struct rad_protocol *protocol, const void *msg, uint32_t percent)
+{
+	uint32_t pulses[RAD_RX_MSG_MAX_LEN];
+	size_t   len = frame_build(protocol, msg, pulses);
+
+	/* The whole frame, start pulse included, runs fast or slow. */
+	for (size_t i=0; i < len; i++) {
+		pulses[i] = ((pulses[i] * percent) / 100);
+	}
+
+	pulses_feed_and_wait(protocol, pulses, len);
+}
+
+static void test_drift_sim(void)
+{
+	rad_msg_dynasty_t dynasty_msg = { .team_id = TEAM_ID_DYNASTY_GREEN, .weapon_id = WEAPON_ID_DYNASTY_ROCKET };
+	rad_msg_rad_t     rad_msg     = { .version = RAD_MSG_VERSION, .team_id = 1, .damage = 7 };
+
+	/* Each of these puts the long symbol outside of RAD_RX_BIT_MARGIN_US. The Rad 1 space
+	 * can't be stretched as much without looking like a line clear.
+	 */
+	drift_feed_and_wait(&rad_msg_type_dynasty_protocol, &dynasty_msg, 80);
+	zassert_equal(rx_msg.dynasty.team_id, dynasty_msg.team_id, "Invalid DYNASTY team_id.");
+	zassert_equal(rx_msg.dynasty.weapon_id, dynasty_msg.weapon_id, "Invalid DYNASTY weapon_id.");
+	drift_feed_and_wait(&rad_msg_type_dynasty_protocol, &dynasty_msg, 118);
+	zassert_equal(rx_msg.dynasty.team_id, dynasty_msg.team_id, "Invalid DYNASTY team_id.");
+	zassert_equal(rx_msg.dynasty.weapon_id, dynasty_msg.weapon_id, "Invalid DYNASTY weapon_id.");
+	drift_feed_and_wait(&rad_msg_type_rad_protocol, &rad_msg, 80);
+	zassert_mem_equal(&rx_msg.rad, &rad_msg, sizeof(rad_msg), "Invalid RAD message data.");
+}
+
+static void test_group_sim(void)
+{
+	rad_msg_laser_x_t msg = { .team_id = TEAM_ID_LASER_X_BLUE };
+	uint32_t          pulses[RAD_RX_MSG_MAX_LEN];
+	size_t            len;
+	int               ret;
+
+	rx1_dev = device_get_binding("rad_rx1");
+	zassert_not_null(rx1_dev, "Failed to get second RX dev binding");
+
+	group_dev = device_get_binding("rad_vest");
+	zassert_not_null(group_dev, "Failed to get group dev binding");
+
+	ret = rad_rx_group_set_callback(group_dev, rad_rx_group_cb);
+	zassert_equal(ret, 0, "Failed to set group callback");
+
+	/* Let the group deliver whatever the first sensor received during the other tests. */
+	k_msleep(GROUP_WINDOW_MS + DECODE_LATENCY_MS);
+	k_sem_reset(&group_received);
+
+	len = frame_build(&rad_msg_type_laser_x_protocol, &msg, pulses);
+
+	/* Both sensors see the same shot. */
+	rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses, len);
+	rad_rx_sim_feed(rx1_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses, len);
+
+	ret = k_sem_take(&group_received, K_MSEC(GROUP_WINDOW_MS + DECODE_LATENCY_MS));
+	zassert_equal(ret, 0, "Group message wasn't received.");
+	zassert_equal(group_sensors, (BIT(0) | BIT(1)), "Unexpected sensors: 0x%x", group_sensors);
+	zassert_mem_equal(&rx_msg.laser_x, &msg, sizeof(msg), "Invalid LASER_X message data.");
+
+	ret = k_sem_take(&group_received, K_MSEC(GROUP_WINDOW_MS + DECODE_LATENCY_MS));
+	zassert_not_equal(ret, 0, "Shot was reported more than once.");
+
+	/* Only the second sensor sees it. */
+	rad_rx_sim_feed(rx1_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses, len);
+
+	ret = k_sem_take(&group_received, K_MSEC(GROUP_WINDOW_MS + DECODE_LATENCY_MS));
+	zassert_equal(ret, 0, "Group message wasn't received.");
+	zassert_equal(group_sensors, BIT(1), "Unexpected sensors: 0x%x", group_sensors);
+
+	/* The first sensor's own callback still ran. */
+	k_sem_reset(&received);
+}
+
+static void test_noise_sim(void)
+{
+	const uint32_t noise[] = {100, 3000, 2500, 200, 1000, 50, 60, 5000};
+	int            ret;
+
+	ret = rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, noise, ARRAY_SIZE(noise));
+	zassert_equal(ret, 0, "rad_rx_sim_feed failed: %d", ret);
+
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_not_equal(ret, 0, "Noise was received as a message.");
+}
+
+static void test_glitch_sim(void)
+{
+	rad_msg_laser_x_t   msg      = { .team_id = TEAM_ID_LASER_X_RED };
+	const uint32_t      spikes[] = {2, 300, 1, 800, 3};
+	uint32_t            pulses[RAD_RX_MSG_MAX_LEN + 2];
+	struct rad_rx_stats before;
+	struct rad_rx_stats after;
+	bool                stats;
+	size_t              len;
+	int                 ret;
+
+	if (0 == CONFIG_RAD_RX_GLITCH_FILTER_US) {
+		ztest_test_skip();
+		return;
+	}
+
+	stats = (0 == rad_rx_stats_get(rx_dev, &before));
+
+	/* Spikes on an idle line don't even start a frame. */
+	rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, spikes, ARRAY_SIZE(spikes));
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_not_equal(ret, 0, "Spikes were received as a message.");
+
+	/* A spike in the middle of the first space of a message. */
+	len = frame_build(&rad_msg_type_laser_x_protocol, &msg, &pulses[2]);
+	pulses[0] = pulses[2];
+	pulses[1] = (pulses[3] / 2);
+	pulses[2] = 1;
+	pulses[3] = (pulses[3] - pulses[1] - pulses[2]);
+	pulses_feed_and_wait(&rad_msg_type_laser_x_protocol, pulses, (len + 2));
+	zassert_mem_equal(&rx_msg.laser_x, &msg, sizeof(msg), "Invalid LASER_X message data.");
+
+	if (stats) {
+		rad_rx_stats_get(rx_dev, &after);
+		zassert_equal((after.glitches - before.glitches), 4, "Unexpected number of glitches.");
+		zassert_equal((after.frames - before.frames), 1, "Spikes started a frame.");
+	}
+}
+
+static void test_mute_sim(void)
+{
+#if !CONFIG_RAD_RX_RECORD
+	rad_msg_laser_x_t   msg = { .team_id = TEAM_ID_LASER_X_BLUE };
+	static uint32_t     burst[CONFIG_RAD_RX_EDGE_RING_SIZE + 2];
+	struct rad_rx_stats before;
+	struct rad_rx_stats after;
+	int                 ret;
+
+	ret = rad_rx_stats_get(rx_dev, &before);
+	zassert_equal(ret, 0, "rad_rx_stats_get failed: %d", ret);
+
+	/**
+	 * A start pulse that no message type accepts. The decoder runs and rejects the frame, but
+	 * for less than the line clear time, which would end the frame.
+	 */
+	rad_rx_sim_edge(rx_dev, RAD_RX_LINE_CLEAR_LEN_US);
+	rad_rx_sim_edge(rx_dev, 300);
+	k_msleep(1);
+
+	/* The rest of the frame is dropped by the ISR, so even more pulses than the ring holds fit. */
+	for (int i=0; i < ARRAY_SIZE(burst); i++) {
+		burst[i] = 300;
+	}
+	rad_rx_sim_feed(rx_dev, 300, burst, ARRAY_SIZE(burst));
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_not_equal(ret, 0, "A rejected frame was received as a message.");
+
+	rad_rx_stats_get(rx_dev, &after);
+	zassert_equal(after.overflows, before.overflows, "Pulses of a muted frame were pushed.");
+
+	/* The mute ends when the line clears. */
+	feed_and_wait(&rad_msg_type_laser_x_protocol, &msg, 0);
+	zassert_mem_equal(&rx_msg.laser_x, &msg, sizeof(msg), "Invalid LASER_X message data.");
+#else
+	/* Recording keeps every pulse of a frame, so rejected frames aren't muted. */
+	ztest_test_skip();
+#endif
+}
+
+static void test_long_mark_sim(void)
+{
+	const struct rad_protocol *protocol = &rad_msg_type_laser_x_protocol;
+	const int32_t              hold_ms  = (3 * DIV_ROUND_UP(RAD_RX_LINE_CLEAR_LEN_US, USEC_PER_MSEC));
+	rad_msg_laser_x_t          msg      = { .team_id = TEAM_ID_LASER_X_RED };
+	uint32_t                   pulses[RAD_RX_MSG_MAX_LEN];
+	size_t                     len      = frame_build(protocol, &msg, pulses);
+	int                        held     = 0;
+	int                        ret;
+
+	/**
+	 * Edge by edge, holding the start pulse and every '1' mark active across several line clear
+	 * deadlines in real time, the way long marks outlast the deadline on hardware.
+	 */
+	rad_rx_sim_edge(rx_dev, RAD_RX_LINE_CLEAR_LEN_US);
+	for (size_t i=0; i < len; i++) {
+		if ((0 == i) || ((0 == (i % 2)) && (pulses[i] == protocol->symbol_len_us[1][1]))) {
+			ret = k_sem_take(&received, K_MSEC(hold_ms));
+			zassert_not_equal(ret, 0, "A message was received in the middle of a mark.");
+			held++;
+		}
+		rad_rx_sim_edge(rx_dev, pulses[i]);
+	}
+	zassert_true(held > 1, "The frame has no '1' mark to hold.");
+
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_equal(ret, 0, "Message wasn't received.");
+	zassert_equal(rx_msg_type, protocol->msg_type,
+		            "Unexpected rad_msg_type_t received: %d != %d", rx_msg_type, protocol->msg_type);
+	zassert_mem_equal(&rx_msg.laser_x, &msg, sizeof(msg), "Invalid LASER_X message data.");
+}
+
+static void test_pm_sim(void)
+{
+#if CONFIG_PM_DEVICE
+	rad_msg_laser_x_t msg = { .team_id = TEAM_ID_LASER_X_BLUE };
+	uint32_t          pulses[RAD_RX_MSG_MAX_LEN];
+	size_t            len = frame_build(&rad_msg_type_laser_x_protocol, &msg, pulses);
+	int               ret;
+
+	ret = pm_device_action_run(rx_dev, PM_DEVICE_ACTION_SUSPEND);
+	zassert_equal(ret, 0, "Suspend failed: %d", ret);
+
+	rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses, len);
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_not_equal(ret, 0, "A suspended receiver received a message.");
+
+	ret = pm_device_action_run(rx_dev, PM_DEVICE_ACTION_RESUME);
+	zassert_equal(ret, 0, "Resume failed: %d", ret);
+
+	pulses_feed_and_wait(&rad_msg_type_laser_x_protocol, pulses, len);
+	zassert_mem_equal(&rx_msg.laser_x, &msg, sizeof(msg), "Invalid LASER_X message data.");
+#else
+	ztest_test_skip();
+#endif
+}
+
+static void test_event_sim(void)
+{
+	rad_msg_laser_x_t   msg = { .team_id = TEAM_ID_LASER_X_RED };
+	struct rad_rx_event events[4];
+	struct k_poll_event poll_event;
+	uint32_t            pulses[RAD_RX_MSG_MAX_LEN];
+	uint32_t            frame_us = 0;
+	size_t              len;
+	int                 ret;
+
+	/* Drop whatever was queued during the other tests. */
+	while (rad_rx_read_batch(rx1_dev, events, ARRAY_SIZE(events), K_NO_WAIT) > 0) {
+	}
+
+	ret = rad_rx_poll_event_init(rx1_dev, &poll_event);
+	zassert_equal(ret, 0, "Failed to init poll event: %d", ret);
+
+	ret = k_poll(&poll_event, 1, K_NO_WAIT);
+	zassert_not_equal(ret, 0, "Poll event signaled with an empty queue.");
+
+	len = frame_build(&rad_msg_type_laser_x_protocol, &msg, pulses);
+	for (size_t i=0; i < len; i++) {
+		frame_us += pulses[i];
+	}
+
+	rad_rx_sim_feed(rx1_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses, len);
+	rad_rx_sim_feed(rx1_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses, len);
+
+	ret = k_poll(&poll_event, 1, K_MSEC(DECODE_LATENCY_MS));
+	zassert_equal(ret, 0, "Poll event wasn't signaled.");
+	zassert_equal(poll_event.state, K_POLL_STATE_MSGQ_DATA_AVAILABLE, "Unexpected poll state.");
+	k_msleep(DECODE_LATENCY_MS);
+
+	ret = rad_rx_read_batch(rx1_dev, events, ARRAY_SIZE(events), K_NO_WAIT);
+	zassert_equal(ret, 2, "Unexpected number of events: %d", ret);
+
+	for (int i=0; i < ret; i++) {
+		zassert_equal(events[i].msg_type, RAD_MSG_TYPE_LASER_X, "Unexpected rad_msg_type_t.");
+		zassert_equal(events[i].sensor_id, RX1_SENSOR_ID, "Unexpected sensor id.");
+		zassert_mem_equal(&events[i].msg.laser_x, &msg, sizeof(msg), "Invalid LASER_X message data.");
+	}
+
+	/* The simulated clock counts microseconds. */
+	zassert_equal((events[1].timestamp - events[0].timestamp), (frame_us + RAD_RX_LINE_CLEAR_LEN_US),
+		      "Unexpected time between frames.");
+
+	ret = rad_rx_read(rx1_dev, &events[0], K_NO_WAIT);
+	zassert_equal(ret, -EAGAIN, "Event read from an empty queue.");
+}
+
+static void test_stats_sim(void)
+{
+	rad_msg_laser_x_t   msg = { .team_id = TEAM_ID_LASER_X_BLUE };
+	struct rad_rx_stats before;
+	struct rad_rx_stats after;
+	uint32_t            pulses[RAD_RX_MSG_MAX_LEN];
+	uint32_t            others_before = 0;
+	uint32_t            others_after  = 0;
+	size_t              len;
+	int                 ret;
+
+	ret = rad_rx_stats_get(rx_dev, &before);
+	if (-ENOTSUP == ret) {
+		ztest_test_skip();
+		return;
+	}
+	zassert_equal(ret, 0, "Failed to get stats: %d", ret);
+
+	len = frame_build(&rad_msg_type_laser_x_protocol, &msg, pulses);
+	zassert_equal((len % 2), 1, "Expected an odd number of pulses.");
+
+	/* A complete frame, then one that stops halfway, then another complete one. */
+	pulses_feed_and_wait(&rad_msg_type_laser_x_protocol, pulses, len);
+	rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses, ((len / 2) & ~1));
+
+	/* The decoder closes the frame once the line has been clear, not when the next one starts. */
+	k_msleep((RAD_RX_LINE_CLEAR_LEN_US / USEC_PER_MSEC) + DECODE_LATENCY_MS);
+	ret = rad_rx_stats_get(rx_dev, &after);
+	zassert_equal(ret, 0, "Failed to get stats: %d", ret);
+	zassert_equal((after.line_clear_timeouts - before.line_clear_timeouts), 1,
+		      "Line clear timeout wasn't counted.");
+
+	pulses_feed_and_wait(&rad_msg_type_laser_x_protocol, pulses, len);
+
+	ret = rad_rx_stats_get(rx_dev, &after);
+	zassert_equal(ret, 0, "Failed to get stats: %d", ret);
+
+	zassert_equal((after.frames - before.frames), 3, "Unexpected number of frames.");
+	zassert_equal((after.edges - before.edges), ((2 * (len + 1)) + ((len / 2) & ~1)),
+		      "Unexpected number of edges.");
+	zassert_equal((after.accepted[RAD_MSG_TYPE_LASER_X] - before.accepted[RAD_MSG_TYPE_LASER_X]), 2,
+		      "Unexpected number of accepted messages.");
+	zassert_equal((after.rejected[RAD_MSG_TYPE_LASER_X][RAD_PARSE_REJECT_TRUNCATED] -
+		       before.rejected[RAD_MSG_TYPE_LASER_X][RAD_PARSE_REJECT_TRUNCATED]), 1,
+		      "Truncated message wasn't counted.");
+	zassert_equal((after.line_clear_timeouts - before.line_clear_timeouts), 1,
+		      "Line clear timeout wasn't counted.");
+	zassert_equal(after.overflows, before.overflows, "Unexpected overflow.");
+
+	/* The other message types gave up on every frame. */
+	for (int i=0; i < RAD_PARSE_REJECT_COUNT; i++) {
+		others_before += (before.rejected[RAD_MSG_TYPE_RAD][i] + before.rejected[RAD_MSG_TYPE_DYNASTY][i]);
+		others_after  += (after.rejected[RAD_MSG_TYPE_RAD][i] + after.rejected[RAD_MSG_TYPE_DYNASTY][i]);
+	}
+	zassert_equal((others_after - others_before), 6, "Unexpected number of rejections.");
+}
+
+static void test_record_sim(void)
+{
+#if CONFIG_RAD_RX_RECORD
+	rad_msg_laser_x_t    msg     = { .team_id = TEAM_ID_LASER_X_NEUTRAL };
+	const uint32_t       noise[] = {300, 700, 1200, 400, 250};
+	uint32_t             pulses[RAD_RX_MSG_MAX_LEN];
+	struct rad_rx_record records[2];
+	static uint16_t      too_long[CONFIG_RAD_RX_EDGE_RING_SIZE];
+	size_t               len;
+	int                  ret;
+
+	/* Earlier tests filled the queue, and their last train is closed once the line is clear. */
+	k_msleep((RAD_RX_LINE_CLEAR_LEN_US / USEC_PER_MSEC) + DECODE_LATENCY_MS);
+	while (0 == rad_rx_record_read(rx_dev, &records[0], K_NO_WAIT)) {
+	}
+
+	len = frame_build(&rad_msg_type_laser_x_protocol, &msg, pulses);
+	rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, noise, ARRAY_SIZE(noise));
+	pulses_feed_and_wait(&rad_msg_type_laser_x_protocol, pulses, len);
+
+	/* The second train is only complete once the line has been clear. */
+	k_msleep((RAD_RX_LINE_CLEAR_LEN_US / USEC_PER_MSEC) + DECODE_LATENCY_MS);
+	for (int i=0; i < ARRAY_SIZE(records); i++) {
+		ret = rad_rx_record_read(rx_dev, &records[i], K_NO_WAIT);
+		zassert_equal(ret, 0, "Pulse train %d wasn't recorded.", i);
+	}
+
+	zassert_equal(records[0].len, ARRAY_SIZE(noise), "Unexpected noise length.");
+	zassert_equal(records[0].flags, 0, "Unexpected noise flags.");
+	for (int i=0; i < ARRAY_SIZE(noise); i++) {
+		zassert_equal(records[0].pulses_us[i], noise[i], "Noise pulse %d differs.", i);
+	}
+
+	zassert_equal(records[1].len, len, "Unexpected message length.");
+	zassert_equal(records[1].flags, RAD_RX_RECORD_FLAG_DECODED, "Unexpected message flags.");
+	for (int i=0; i < len; i++) {
+		zassert_equal(records[1].pulses_us[i], pulses[i], "Message pulse %d differs.", i);
+	}
+
+	/* Replaying gives the same results. */
+	ret = rad_rx_replay(rx_dev, records[0].pulses_us, records[0].len);
+	zassert_equal(ret, 0, "Replay failed: %d", ret);
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_not_equal(ret, 0, "Replayed noise was received as a message.");
+
+	memset(&rx_msg, 0, sizeof(rx_msg));
+	ret = rad_rx_replay(rx_dev, records[1].pulses_us, records[1].len);
+	zassert_equal(ret, 0, "Replay failed: %d", ret);
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_equal(ret, 0, "Replayed message wasn't received.");
+	zassert_mem_equal(&rx_msg.laser_x, &msg, sizeof(msg), "Invalid LASER_X message data.");
+
+	/* Trains that could never be replayed aren't reported as busy. */
+	ret = rad_rx_replay(rx_dev, records[1].pulses_us, 0);
+	zassert_equal(ret, -EINVAL, "Empty replay wasn't rejected: %d", ret);
+	ret = rad_rx_replay(rx_dev, too_long, ARRAY_SIZE(too_long));
+	zassert_equal(ret, -EINVAL, "Oversized replay wasn't rejected: %d", ret);
+#else
+	ztest_test_skip();
+#endif
+}
+
+static void test_repeat_sim(void)
+{
+#if CONFIG_RAD_RX_REPEAT_SUPPRESS
+	const uint16_t      window_ms = 30;
+	rad_msg_laser_x_t   msgs[]    = {{ .team_id = TEAM_ID_LASER_X_RED }, { .team_id = TEAM_ID_LASER_X_BLUE }};
+	uint32_t            pulses[2][RAD_RX_MSG_MAX_LEN];
+	struct rad_rx_event event;
+	struct rad_rx_stats before;
+	struct rad_rx_stats after;
+	size_t              len;
+	int                 ret;
+
+	ret = rad_rx_repeat_window_set(rx_dev, RAD_MSG_TYPE_LASER_X, window_ms);
+	zassert_equal(ret, 0, "rad_rx_repeat_window_set failed: %d", ret);
+
+	while (0 == rad_rx_read(rx_dev, &event, K_NO_WAIT)) {
+	}
+	rad_rx_stats_get(rx_dev, &before);
+
+	len = frame_build(&rad_msg_type_laser_x_protocol, &msgs[0], pulses[0]);
+	frame_build(&rad_msg_type_laser_x_protocol, &msgs[1], pulses[1]);
+
+	/* Three copies of the same shot are one hit. */
+	for (int i=0; i < 3; i++) {
+		rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses[0], len);
+	}
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_not_equal(ret, 0, "Message was delivered before its repeats were over.");
+	ret = k_sem_take(&received, K_MSEC(window_ms + DECODE_LATENCY_MS));
+	zassert_equal(ret, 0, "Message wasn't received.");
+	zassert_mem_equal(&rx_msg.laser_x, &msgs[0], sizeof(msgs[0]), "Invalid LASER_X message data.");
+	ret = k_sem_take(&received, K_MSEC(window_ms + DECODE_LATENCY_MS));
+	zassert_not_equal(ret, 0, "Repeat was delivered.");
+
+	ret = rad_rx_read(rx_dev, &event, K_NO_WAIT);
+	zassert_equal(ret, 0, "Event wasn't queued.");
+	zassert_equal(event.repeats, 3, "Unexpected repeat count: %u", event.repeats);
+	ret = rad_rx_read(rx_dev, &event, K_NO_WAIT);
+	zassert_equal(ret, -EAGAIN, "Repeat was queued.");
+
+	rad_rx_stats_get(rx_dev, &after);
+	zassert_equal((after.repeats - before.repeats), 2, "Repeats weren't counted.");
+	zassert_equal((after.accepted[RAD_MSG_TYPE_LASER_X] - before.accepted[RAD_MSG_TYPE_LASER_X]), 3,
+		      "Every copy should be accepted.");
+
+	/* A different message ends the repeats of the previous one right away. */
+	rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses[0], len);
+	rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses[1], len);
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_equal(ret, 0, "Previous message wasn't delivered.");
+	zassert_mem_equal(&rx_msg.laser_x, &msgs[0], sizeof(msgs[0]), "Invalid LASER_X message data.");
+	ret = k_sem_take(&received, K_MSEC(window_ms + DECODE_LATENCY_MS));
+	zassert_equal(ret, 0, "Message wasn't received.");
+	zassert_mem_equal(&rx_msg.laser_x, &msgs[1], sizeof(msgs[1]), "Invalid LASER_X message data.");
+
+	/* So does a copy that starts after the window, which is another shot. */
+	rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses[0], len);
+	rad_rx_sim_feed(rx_dev, (window_ms * USEC_PER_MSEC), pulses[0], len);
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_equal(ret, 0, "First shot wasn't delivered.");
+	ret = k_sem_take(&received, K_MSEC(window_ms + DECODE_LATENCY_MS));
+	zassert_equal(ret, 0, "Second shot wasn't delivered.");
+
+	for (int i=0; i < 4; i++) {
+		ret = rad_rx_read(rx_dev, &event, K_NO_WAIT);
+		zassert_equal(ret, 0, "Event wasn't queued.");
+		zassert_equal(event.repeats, 1, "Unexpected repeat count: %u", event.repeats);
+	}
+
+	rad_rx_repeat_window_set(rx_dev, RAD_MSG_TYPE_LASER_X, 0);
+#else
+	ztest_test_skip();
+#endif
+}
+
+#if CONFIG_RAD_RX_ACCEPT_LEARNED
+#define UNKNOWN_START_US  3000
+#define UNKNOWN_MARK_US   500
+#define UNKNOWN_SPACE0_US 500
+#define UNKNOWN_SPACE1_US 1100
+#define UNKNOWN_LEN_BITS  12
+
+/* A pulse distance blaster that none of the rad_msg_type libraries know about. */
+static size_t unknown_frame_build(uint32_t value, int32_t jitter_us, uint32_t *pulses)
+{
+	size_t len = 0;
+
+	pulses[len++] = UNKNOWN_START_US;
+	for (int i=(UNKNOWN_LEN_BITS - 1); i >= 0; i--) {
+		pulses[len++] = (((value >> i) & 1) ? UNKNOWN_SPACE1_US : UNKNOWN_SPACE0_US) + jitter_us;
+		pulses[len++] = UNKNOWN_MARK_US - jitter_us;
+	}
+	return len;
+}
+#endif
+
+static void test_learn_sim(void)
+{
+#if CONFIG_RAD_RX_ACCEPT_LEARNED
+	const uint32_t          shots[] = {0xA5C, 0x3F0, 0x0F3, 0x801};
+	uint32_t                pulses[RAD_RX_MSG_MAX_LEN];
+	uint16_t                pulses_us[RAD_RX_MSG_MAX_LEN];
+	struct rad_learn        learn;
+	struct rad_learn_result result;
+	size_t                  len;
+	int                     ret;
+
+	rad_learn_init(&learn);
+	ret = rad_learn_finish(&learn, &result);
+	zassert_equal(ret, -ENODATA, "Learned from nothing: %d", ret);
+
+	for (int i=0; i < ARRAY_SIZE(shots); i++) {
+		len = unknown_frame_build(shots[i], ((i % 3) - 1) * 30, pulses);
+		for (size_t j=0; j < len; j++) {
+			pulses_us[j] = pulses[j];
+		}
+
+		ret = rad_learn_add(&learn, pulses_us, len);
+		zassert_equal(ret, 0, "rad_learn_add failed: %d", ret);
+	}
+
+	/* A frame of another length doesn't belong with the others. */
+	ret = rad_learn_add(&learn, pulses_us, (len - 2));
+	zassert_equal(ret, -EMSGSIZE, "Short frame was added: %d", ret);
+
+	ret = rad_learn_finish(&learn, &result);
+	zassert_equal(ret, 0, "rad_learn_finish failed: %d", ret);
+	zassert_equal(result.frames, ARRAY_SIZE(shots), "Unexpected number of frames.");
+	zassert_equal(result.len_bits, UNKNOWN_LEN_BITS, "Unexpected length.");
+	zassert_equal(result.pulses_per_bit, 2, "Unexpected encoding.");
+	zassert_within(result.start_pulse_len_us, UNKNOWN_START_US, RAD_LEARN_BIN_US, "Unexpected start pulse.");
+	zassert_within(result.symbol_len_us[0][0], UNKNOWN_SPACE0_US, RAD_LEARN_BIN_US, "Unexpected 0 space.");
+	zassert_within(result.symbol_len_us[1][0], UNKNOWN_SPACE1_US, RAD_LEARN_BIN_US, "Unexpected 1 space.");
+	zassert_within(result.symbol_len_us[0][1], UNKNOWN_MARK_US, RAD_LEARN_BIN_US, "Unexpected 0 mark.");
+	zassert_within(result.symbol_len_us[1][1], UNKNOWN_MARK_US, RAD_LEARN_BIN_US, "Unexpected 1 mark.");
+
+	/* Unknown frames are ignored until the message type is described. */
+	len = unknown_frame_build(0x5A6, 0, pulses);
+	rad_rx_sim_feed(rx_dev, RAD_RX_LINE_CLEAR_LEN_US, pulses, len);
+	ret = k_sem_take(&received, K_MSEC(DECODE_LATENCY_MS));
+	zassert_not_equal(ret, 0, "Unknown frame was received.");
+
+	ret = rad_msg_type_learned_set(&result);
+	zassert_equal(ret, 0, "rad_msg_type_learned_set failed: %d", ret);
+
+	memset(&rx_msg, 0, sizeof(rx_msg));
+	pulses_feed_and_wait(&rad_msg_type_learned_protocol, pulses, len);
+	zassert_equal(rx_msg.learned.len_bits, UNKNOWN_LEN_BITS, "Invalid LEARNED length.");
+	zassert_equal(rx_msg.learned.words[0], 0x5A6, "Invalid LEARNED message data.");
+
+	/* The known message types still work. */
+	test_laser_x_sim();
+#else
+	ztest_test_skip();
+#endif
+}
+
+void test_main(void)
+{
+	ztest_test_suite(test_rad_rx_sim,
+		ztest_unit_test(test_get_binding),
+		ztest_unit_test(test_laser_x_sim),
+		ztest_unit_test(test_dynasty_sim),
+		ztest_unit_test(test_rad_sim),
+		ztest_unit_test(test_margin_sim),
+		ztest_unit_test(test_drift_sim),
+		ztest_unit_test(test_soft_sim),
+		ztest_unit_test(test_repair_sim),
+		ztest_unit_test(test_collision_sim),
+		ztest_unit_test(test_group_sim),
+		ztest_unit_test(test_noise_sim),
+		ztest_unit_test(test_glitch_sim),
+		ztest_unit_test(test_mute_sim),
+		ztest_unit_test(test_long_mark_sim),
+		ztest_unit_test(test_pm_sim),
+		ztest_unit_test(test_event_sim),
+		ztest_unit_test(test_stats_sim),
+		ztest_unit_test(test_record_sim),
+		ztest_unit_test(test_repeat_sim),
+		ztest_unit_test(test_learn_sim)
+	);
+
+	ztest_run_test_suite(test_rad_rx_sim);
+}